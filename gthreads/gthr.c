@@ -1,14 +1,34 @@
+#define _GNU_SOURCE // gettid()
 #include "gthr.h"
 #include "gthr_struct.h"
 
-// Define thread_params directly in gthr.c
-struct thread_data thread_params[MAX_G_THREADS];
+// Carrier of the calling kernel thread. A thread may resume on another carrier after every switch,
+// so this is read again each time: noipa keeps the compiler from reusing an earlier result.
+static __attribute__((noipa)) struct gt_carrier *this_carrier(void) {
+    return gt_this_carrier;
+}
+
+// thread running on the calling carrier
+#define gt_current (this_carrier()->current)
+
+static bool schedule(int *unlock);
 
 // Calculate microseconds between two timevals
 static unsigned long time_elapsed_us(struct timeval *start, struct timeval *end) {
     return (end->tv_sec - start->tv_sec) * 1000000 + (end->tv_usec - start->tv_usec);
 }
 
+// Microseconds since the epoch, the clock of the metrics and of the EDF deadlines
+static unsigned long timeval_us(const struct timeval *t) {
+    return t->tv_sec * 1000000UL + t->tv_usec;
+}
+
+static unsigned long now_us(void) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return timeval_us(&now);
+}
+
 // Initialize thread performance metrics
 static void init_thread_metrics(struct gt_metrics *m) {
     gettimeofday(&m->creation_time, NULL);
@@ -29,227 +49,1206 @@ static void init_thread_metrics(struct gt_metrics *m) {
     m->wait_time_sum = 0;
     m->wait_time_sq_sum = 0;
     m->wait_periods = 0;
+
+    m->edf_jobs = 0;
+    m->edf_deadline_misses = 0;
+    m->edf_throttles = 0;
+}
+
+// splitmix64 step, expands a seed into generator state
+static uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+// Seed a carrier's generator, each carrier draws its own sequence from the common seed
+static void seed_random(struct gt_carrier *c, uint64_t seed) {
+    uint64_t x = seed + c->index * 0x9e3779b97f4a7c15;
+    for (int i = 0; i < 4; i++) {
+        c->random_state[i] = splitmix64(&x);
+    }
+}
+
+static uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+// Next number of a carrier's xoshiro256** generator
+static uint64_t carrier_random(struct gt_carrier *c) {
+    uint64_t *s = c->random_state;
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+}
+
+// Thread control block of a thread ID
+static struct gt *gt_thread(unsigned id) {
+    return &gt_chunks[id / GT_CHUNK_SIZE][id % GT_CHUNK_SIZE];
+}
+
+// Take an Unused thread, reusing an exited one before growing the table by a chunk
+static struct gt *alloc_thread(void) {
+    struct gt *p = gt_free_threads;
+    if (p) {
+        gt_free_threads = p->run_next;
+        return p;
+    }
+
+    if (gt_thread_count == gt_chunk_count * GT_CHUNK_SIZE) {
+        struct gt **chunks = realloc(gt_chunks, (gt_chunk_count + 1) * sizeof(*chunks));
+        if (!chunks) {
+            return NULL;
+        }
+        gt_chunks = chunks;
+        gt_chunks[gt_chunk_count] = calloc(GT_CHUNK_SIZE, sizeof(struct gt));
+        if (!gt_chunks[gt_chunk_count]) {
+            return NULL;
+        }
+        gt_chunk_count++;
+    }
+    p = gt_thread(gt_thread_count);
+    p->id = gt_thread_count++;
+    return p;
+}
+
+// Return a thread to the free list, its ID is handed out again by the next gt_create()
+static void free_thread(struct gt *p) {
+    p->state = Unused;
+    p->run_next = gt_free_threads;
+    gt_free_threads = p;
+}
+
+// Usable size of a requested stack: its power-of-two size class, at least STACK_MIN_SIZE
+static size_t stack_class_size(size_t size) {
+    size_t class_size = STACK_MIN_SIZE;
+    while (class_size < size) {
+        class_size <<= 1;
+    }
+    return class_size;
+}
+
+// Take a stack of the given class size from the pool or map a new one. Stacks are mapped with
+// MAP_NORESERVE, so only the pages a thread actually touches are committed.
+static char *stack_alloc(size_t size) {
+    struct gt_free_stack **pool = &gt_stack_pool[__builtin_ctzl(size)];
+    if (*pool) {
+        struct gt_free_stack *s = *pool;
+        *pool = s->next;
+        gt_stack_pool_count--;
+        return (char *) s - STACK_GUARD_SIZE;
+    }
+
+    char *stack = mmap(NULL, STACK_GUARD_SIZE + size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if (stack == MAP_FAILED) {
+        return NULL;
+    }
+    if (mprotect(stack, STACK_GUARD_SIZE, PROT_NONE) == -1) { // the stack grows down into the guard page
+        munmap(stack, STACK_GUARD_SIZE + size);
+        return NULL;
+    }
+    return stack;
+}
+
+// Put the stack of an exited thread into the pool, or unmap it once the pool is full
+static void stack_release(char *stack, size_t size) {
+    if (gt_stack_pool_count >= STACK_POOL_MAX) {
+        munmap(stack, STACK_GUARD_SIZE + size);
+        return;
+    }
+    struct gt_free_stack *s = (struct gt_free_stack *) (stack + STACK_GUARD_SIZE);
+    if (gt_stack_trim) {
+        madvise((char *) s + STACK_GUARD_SIZE, size - STACK_GUARD_SIZE, MADV_DONTNEED); // keep only the link page
+    }
+    struct gt_free_stack **pool = &gt_stack_pool[__builtin_ctzl(size)];
+    s->next = *pool;
+    *pool = s;
+    gt_stack_pool_count++;
+}
+
+// Spinlocks between carriers, taken with preemption disabled. A waiter gives up its core now and
+// then, the holder may be a kernel thread that is not running.
+static void spin_lock(int *lock) {
+    unsigned spins = 0;
+    while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n(lock, __ATOMIC_RELAXED)) {
+            if (++spins % 64 == 0) {
+                sched_yield();
+            } else {
+                __builtin_ia32_pause();
+            }
+        }
+    }
+}
+
+static void spin_unlock(int *lock) {
+    __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+// Owner: offer a thread for stealing, false when the deque is full
+static bool deque_push(struct gt_deque *d, struct gt *p) {
+    long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+    long t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    if (b - t >= GT_DEQUE_SIZE) {
+        return false;
+    }
+    __atomic_store_n(&d->slots[b & (GT_DEQUE_SIZE - 1)], p, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE); // the thread's context is visible before the slot
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+// Owner: take back the thread offered last
+static struct gt *deque_pop(struct gt_deque *d) {
+    long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long t = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+    if (t > b) { // empty
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    struct gt *p = __atomic_load_n(&d->slots[b & (GT_DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+    if (t == b) { // the last thread, thieves may be taking it as well
+        if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            p = NULL;
+        }
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return p;
+}
+
+// Thief: take the thread offered first, NULL when the deque is empty or another carrier won it
+static struct gt *deque_steal(struct gt_deque *d) {
+    long t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b) {
+        return NULL;
+    }
+    struct gt *p = __atomic_load_n(&d->slots[t & (GT_DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return NULL;
+    }
+    return p;
+}
+
+// Label and ID from the thread's creation parameters, for messages
+static const char *thread_label(const struct gt *p) {
+    return p->data ? p->data->label : "Thread";
+}
+
+static int thread_label_id(const struct gt *p) {
+    return p->data ? p->data->id : 0;
+}
+
+// Keep the timer from preempting the current thread while scheduler state is being changed, the
+// previous signal mask is saved for preempt_restore(). gt_schedule() re-enables preemption through
+// gt_reset_sig() once the thread resumes.
+static void preempt_disable(sigset_t *saved) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &set, saved);
+}
+
+static void preempt_restore(const sigset_t *saved) {
+    pthread_sigmask(SIG_SETMASK, saved, NULL);
+}
+
+// Scheduling rounds of its carrier a Ready thread has been waiting
+static int thread_starvation(const struct gt *p) {
+    return p->state == Ready ? (int) (p->carrier->sched_ticks - p->ready_tick) : 0;
+}
+
+// Priority after aging: under the priority scheduler a Ready thread gains one level per round it waits,
+// and once it waited more than STARVATION_LIMIT rounds it outranks every thread that did not
+static int effective_priority(const struct gt *p) {
+    if (p->state != Ready || !p->sched->aging) {
+        return p->priority;
+    }
+    int starvation = thread_starvation(p);
+    if (starvation > STARVATION_LIMIT) {
+        return MIN_PRIORITY - 1;
+    }
+    return p->priority - starvation < MIN_PRIORITY ? MIN_PRIORITY : p->priority - starvation;
+}
+
+// Reserve the slot arrays of a carrier on first use. Only the pages of slots in use get committed,
+// the tree grows in place and is never copied, in particular not inside the scheduler.
+static void reserve_slots(struct gt_carrier *c) {
+    c->ready_slots = mmap(NULL, READY_SLOTS * sizeof(struct gt *), PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    c->lottery_tree = mmap(NULL, (READY_SLOTS + 1) * sizeof(long), PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (c->ready_slots == MAP_FAILED || c->lottery_tree == MAP_FAILED) {
+        perror("gthreads");
+        abort();
+    }
+    c->lottery_capacity = 1;
+}
+
+// Add delta to the tickets of a lottery slot
+static void lottery_add(struct gt_carrier *c, unsigned slot, long delta) {
+    for (unsigned i = slot + 1; i <= c->lottery_capacity; i += i & -i) {
+        c->lottery_tree[i] += delta;
+    }
+}
+
+// Enter a Ready thread into its carrier's lottery
+static void lottery_insert(struct gt_carrier *c, struct gt *p) {
+    if (!c->lottery_tree) {
+        reserve_slots(c);
+    }
+    if (c->slot_count == c->lottery_capacity) {
+        if (c->lottery_capacity == READY_SLOTS) {
+            fprintf(stderr, "gthreads: more than %d Ready threads on a carrier\n", READY_SLOTS);
+            abort();
+        }
+        // The slots above the old capacity are empty, the new root covers the same tickets as the old one
+        c->lottery_tree[c->lottery_capacity * 2] = c->lottery_tree[c->lottery_capacity];
+        c->lottery_capacity *= 2;
+    }
+    unsigned slot = c->slot_count++;
+    c->ready_slots[slot] = p;
+    p->ready_slot = slot;
+    lottery_add(c, slot, p->tickets);
+}
+
+// Take a thread out of the lottery, the thread of the last slot moves into its slot
+static void lottery_remove(struct gt_carrier *c, struct gt *p) {
+    unsigned last = --c->slot_count;
+    struct gt *moved = c->ready_slots[last];
+    lottery_add(c, last, -moved->tickets);
+    if (moved != p) {
+        lottery_add(c, p->ready_slot, moved->tickets - p->tickets);
+        c->ready_slots[p->ready_slot] = moved;
+        moved->ready_slot = p->ready_slot;
+    }
+}
+
+// Stride heap order: lower pass first, the thread ID breaks ties so that runs are deterministic
+static bool stride_before(const struct gt *a, const struct gt *b) {
+    return a->pass < b->pass || (a->pass == b->pass && a->id < b->id);
+}
+
+static void stride_place(struct gt_carrier *c, unsigned slot, struct gt *p) {
+    c->ready_slots[slot] = p;
+    p->ready_slot = slot;
+}
+
+// Restore the heap order around a slot whose thread changed
+static void stride_sift(struct gt_carrier *c, unsigned slot) {
+    struct gt *p = c->ready_slots[slot];
+    while (slot > 0 && stride_before(p, c->ready_slots[(slot - 1) / 2])) {
+        stride_place(c, slot, c->ready_slots[(slot - 1) / 2]);
+        slot = (slot - 1) / 2;
+    }
+    while (true) {
+        unsigned child = 2 * slot + 1;
+        if (child >= c->slot_count) {
+            break;
+        }
+        if (child + 1 < c->slot_count && stride_before(c->ready_slots[child + 1], c->ready_slots[child])) {
+            child++;
+        }
+        if (!stride_before(c->ready_slots[child], p)) {
+            break;
+        }
+        stride_place(c, slot, c->ready_slots[child]);
+        slot = child;
+    }
+    stride_place(c, slot, p);
 }
 
-// Seed the random number generator if it hasn't been initialized yet
-static void ensure_random_initialized() {
-    static bool initialized = false;
-    if (!initialized) {
-        srand(time(NULL));
-        initialized = true;
+// Enter a Ready thread into its carrier's stride heap. A thread that was not Ready for a while, or
+// comes from another carrier, joins within one stride of the carrier's pass: it neither catches up on
+// the time it did not compete nor waits for time it was charged elsewhere.
+static void stride_insert(struct gt_carrier *c, struct gt *p) {
+    if (!c->ready_slots) {
+        reserve_slots(c);
+    }
+    if (c->slot_count == READY_SLOTS) {
+        fprintf(stderr, "gthreads: more than %d Ready threads on a carrier\n", READY_SLOTS);
+        abort();
+    }
+    if (p->pass < c->stride_pass) {
+        p->pass = c->stride_pass;
+    } else if (p->pass > c->stride_pass + p->stride) {
+        p->pass = c->stride_pass + p->stride;
+    }
+    stride_place(c, c->slot_count++, p);
+    stride_sift(c, p->ready_slot);
+}
+
+// Take a thread out of the stride heap, the thread of the last slot fills the gap
+static void stride_remove(struct gt_carrier *c, struct gt *p) {
+    struct gt *moved = c->ready_slots[--c->slot_count];
+    if (moved != p) {
+        stride_place(c, p->ready_slot, moved);
+        stride_sift(c, moved->ready_slot);
+    }
+}
+
+// A thread new to the stride scheduler joins at the pass of the carrier it is queued on
+static void stride_attach(struct gt *p) {
+    p->stride = STRIDE1 / p->tickets;
+    p->pass = 0;
+}
+
+// Weight of a priority under the fair scheduler, each level gets about 1.25 times the CPU time of the
+// next lower one (the Linux nice weights of -5..5)
+static const unsigned long fair_weights[MAX_PRIORITY + 1] = {
+    3121, 2501, 1991, 1586, 1277, 1024, 820, 655, 526, 423, 335,
+};
+#define FAIR_WEIGHT_UNIT 1024 // weight at which vruntime advances like wall-clock time
+
+#define rb_thread(node) ((struct gt *) ((char *) (node) - offsetof(struct gt, rb_node)))
+
+// Fair tree order: lower vruntime first, among equal ones the thread inserted first
+static bool fair_before(const struct gt *a, const struct gt *b) {
+    return a->vruntime < b->vruntime || (a->vruntime == b->vruntime && a->fair_seq < b->fair_seq);
+}
+
+static void rb_replace_child(struct gt_rb_tree *t, struct gt_rb_node *old, struct gt_rb_node *new) {
+    if (!old->parent) {
+        t->root = new;
+    } else if (old == old->parent->left) {
+        old->parent->left = new;
+    } else {
+        old->parent->right = new;
+    }
+    if (new) {
+        new->parent = old->parent;
+    }
+}
+
+static void rb_rotate_left(struct gt_rb_tree *t, struct gt_rb_node *x) {
+    struct gt_rb_node *y = x->right;
+    x->right = y->left;
+    if (y->left) {
+        y->left->parent = x;
+    }
+    rb_replace_child(t, x, y);
+    y->left = x;
+    x->parent = y;
+}
+
+static void rb_rotate_right(struct gt_rb_tree *t, struct gt_rb_node *x) {
+    struct gt_rb_node *y = x->left;
+    x->left = y->right;
+    if (y->right) {
+        y->right->parent = x;
+    }
+    rb_replace_child(t, x, y);
+    y->right = x;
+    x->parent = y;
+}
+
+// Link a node into a tree of threads ordered by before() and rebalance. Threads comparing equal
+// keep their insertion order.
+static void rb_insert(struct gt_rb_tree *t, struct gt_rb_node *z,
+                      bool (*before)(const struct gt *, const struct gt *)) {
+    struct gt_rb_node *parent = NULL, **link = &t->root;
+    bool leftmost = true;
+    while (*link) {
+        parent = *link;
+        if (before(rb_thread(z), rb_thread(parent))) {
+            link = &parent->left;
+        } else {
+            link = &parent->right;
+            leftmost = false;
+        }
+    }
+    z->left = z->right = NULL;
+    z->parent = parent;
+    z->red = true;
+    *link = z;
+    if (leftmost) {
+        t->leftmost = z;
+    }
+
+    while (z->parent && z->parent->red) {
+        struct gt_rb_node *grandparent = z->parent->parent; // exists, the red parent is not the root
+        if (z->parent == grandparent->left) {
+            struct gt_rb_node *uncle = grandparent->right;
+            if (uncle && uncle->red) {
+                z->parent->red = uncle->red = false;
+                grandparent->red = true;
+                z = grandparent;
+                continue;
+            }
+            if (z == z->parent->right) {
+                z = z->parent;
+                rb_rotate_left(t, z);
+            }
+            z->parent->red = false;
+            grandparent->red = true;
+            rb_rotate_right(t, grandparent);
+        } else {
+            struct gt_rb_node *uncle = grandparent->left;
+            if (uncle && uncle->red) {
+                z->parent->red = uncle->red = false;
+                grandparent->red = true;
+                z = grandparent;
+                continue;
+            }
+            if (z == z->parent->left) {
+                z = z->parent;
+                rb_rotate_right(t, z);
+            }
+            z->parent->red = false;
+            grandparent->red = true;
+            rb_rotate_left(t, grandparent);
+        }
+    }
+    t->root->red = false;
+}
+
+// Unlink a node from its tree and rebalance
+static void rb_erase(struct gt_rb_tree *t, struct gt_rb_node *z) {
+    struct gt_rb_node *x, *parent, *y;
+    bool removed_red = z->red;
+
+    if (z == t->leftmost) { // its successor: z has no left child
+        struct gt_rb_node *next = z->right;
+        if (next) {
+            while (next->left) {
+                next = next->left;
+            }
+        } else {
+            next = z->parent;
+        }
+        t->leftmost = next;
+    }
+
+    if (!z->left || !z->right) {
+        x = z->left ? z->left : z->right;
+        parent = z->parent;
+        rb_replace_child(t, z, x);
+    } else {
+        y = z->right; // successor of z takes its place
+        while (y->left) {
+            y = y->left;
+        }
+        removed_red = y->red;
+        x = y->right;
+        if (y->parent == z) {
+            parent = y;
+        } else {
+            parent = y->parent;
+            rb_replace_child(t, y, x);
+            y->right = z->right;
+            y->right->parent = y;
+        }
+        rb_replace_child(t, z, y);
+        y->left = z->left;
+        y->left->parent = y;
+        y->red = z->red;
+    }
+    if (removed_red) {
+        return;
+    }
+
+    // x carries an extra black
+    while (x != t->root && (!x || !x->red)) {
+        if (x == parent->left) {
+            struct gt_rb_node *sibling = parent->right;
+            if (sibling->red) {
+                sibling->red = false;
+                parent->red = true;
+                rb_rotate_left(t, parent);
+                sibling = parent->right;
+            }
+            if ((!sibling->left || !sibling->left->red) && (!sibling->right || !sibling->right->red)) {
+                sibling->red = true;
+                x = parent;
+                parent = x->parent;
+                continue;
+            }
+            if (!sibling->right || !sibling->right->red) {
+                sibling->left->red = false;
+                sibling->red = true;
+                rb_rotate_right(t, sibling);
+                sibling = parent->right;
+            }
+            sibling->red = parent->red;
+            parent->red = false;
+            sibling->right->red = false;
+            rb_rotate_left(t, parent);
+        } else {
+            struct gt_rb_node *sibling = parent->left;
+            if (sibling->red) {
+                sibling->red = false;
+                parent->red = true;
+                rb_rotate_right(t, parent);
+                sibling = parent->left;
+            }
+            if ((!sibling->left || !sibling->left->red) && (!sibling->right || !sibling->right->red)) {
+                sibling->red = true;
+                x = parent;
+                parent = x->parent;
+                continue;
+            }
+            if (!sibling->left || !sibling->left->red) {
+                sibling->right->red = false;
+                sibling->red = true;
+                rb_rotate_left(t, sibling);
+                sibling = parent->left;
+            }
+            sibling->red = parent->red;
+            parent->red = false;
+            sibling->left->red = false;
+            rb_rotate_right(t, parent);
+        }
+        x = t->root;
+    }
+    if (x) {
+        x->red = false;
+    }
+}
+
+// Enter a Ready thread into its carrier's fair tree. A thread that was not Ready for a while, or comes
+// from another carrier, is placed near the carrier's min_vruntime: a sleeper is credited at most half
+// the target latency, and a thread charged elsewhere does not wait more than the target latency.
+static void fair_insert(struct gt_carrier *c, struct gt *p) {
+    unsigned long latency = FAIR_LATENCY_US * 1000UL;
+    unsigned long floor = c->min_vruntime > latency / 2 ? c->min_vruntime - latency / 2 : 0;
+    if (p->vruntime < floor) {
+        p->vruntime = floor;
+    } else if (p->vruntime > c->min_vruntime + latency) {
+        p->vruntime = c->min_vruntime + latency;
+    }
+    p->fair_seq = c->fair_seq++;
+    rb_insert(&c->fair_tree, &p->rb_node, fair_before);
+    c->fair_weight += fair_weights[p->priority];
+}
+
+static void fair_remove(struct gt_carrier *c, struct gt *p) {
+    rb_erase(&c->fair_tree, &p->rb_node);
+    c->fair_weight -= fair_weights[p->priority];
+}
+
+// Charge a thread's execution time to its vruntime, scaled inversely to its weight. A run shorter
+// than the microsecond resolution of the metrics still costs one, or a thread yielding in a tight
+// loop would never advance and keep the carrier to itself.
+static void fair_tick(struct gt_carrier *c, struct gt *p, unsigned long exec_us, const struct timeval *now) {
+    if (exec_us == 0) {
+        exec_us = 1;
+    }
+    p->vruntime += exec_us * 1000 * FAIR_WEIGHT_UNIT / fair_weights[p->priority];
+}
+
+// A woken thread preempts the running one if it is behind it by more than the wakeup granularity,
+// as of the running thread's last charge
+static bool fair_wake(struct gt_carrier *c, struct gt *p) {
+    return c->current->vruntime > p->vruntime + FAIR_WAKEUP_GRANULARITY_US * 1000UL;
+}
+
+// Time slice of the running thread under the fair scheduler: its weight's share of the target
+// latency, which stretches so that no Ready thread gets less than FAIR_MIN_GRANULARITY_US
+static long fair_slice_us(struct gt_carrier *c) {
+    unsigned long weight = fair_weights[c->current->priority];
+    unsigned long period = FAIR_LATENCY_US;
+    if ((c->nr_ready + 1) * FAIR_MIN_GRANULARITY_US > period) {
+        period = (c->nr_ready + 1) * FAIR_MIN_GRANULARITY_US;
+    }
+    long slice = (long) (period * weight / (c->fair_weight + weight));
+    return slice < FAIR_MIN_GRANULARITY_US ? FAIR_MIN_GRANULARITY_US : slice;
+}
+
+// Time a thread may use at an MLFQ level before it moves down a level
+static unsigned long mlfq_quantum_us(int level) {
+    return gt_mlfq_quantum_us[level] ? gt_mlfq_quantum_us[level] : (unsigned long) TIME_SLICE_US << level;
+}
+
+// Move a thread to the top MLFQ level with a fresh allotment
+static void mlfq_reset(struct gt *p, unsigned long epoch) {
+    p->priority = 0;
+    p->mlfq_used = 0;
+    p->mlfq_epoch = epoch;
+}
+
+// Periodic boost: once per boost interval the Ready threads of a carrier move back to the top level,
+// a thread that ran long at a low level gets its turn. The other threads follow when they are queued
+// next, mlfq_enqueue() compares their epoch.
+static void mlfq_boost(struct gt_carrier *c, const struct timeval *now) {
+    unsigned long epoch = timeval_us(now) / gt_mlfq_boost_us;
+    if (epoch <= c->mlfq_epoch) {
+        return;
+    }
+    c->mlfq_epoch = epoch;
+    struct gt_run_queue *top = &c->run_queues[0];
+    for (unsigned level = 0; level < gt_mlfq_levels; level++) {
+        struct gt_run_queue *queue = &c->run_queues[level];
+        if (!queue->head) {
+            continue;
+        }
+        for (struct gt *p = queue->head; p; p = p->run_next) {
+            mlfq_reset(p, epoch);
+        }
+        if (queue != top) {
+            queue->head->run_prev = top->tail;
+            if (top->tail) {
+                top->tail->run_next = queue->head;
+            } else {
+                top->head = queue->head;
+            }
+            top->tail = queue->tail;
+            queue->head = queue->tail = NULL;
+        }
+    }
+    c->ready_bitmap = top->head ? 1 : 0;
+}
+
+// Charge a run period under the MLFQ scheduler, and boost the carrier once a new boost interval
+// started. A thread that used up the time of its level, over one or more periods, moves down a level.
+// As for the fair scheduler, a run shorter than the resolution of the metrics costs a microsecond.
+static void mlfq_tick(struct gt_carrier *c, struct gt *p, unsigned long exec_us, const struct timeval *now) {
+    p->mlfq_used += exec_us ? exec_us : 1;
+    if (p->state == Running && p->mlfq_used >= mlfq_quantum_us(p->priority)) {
+        if (p->priority + 1 < (int) gt_mlfq_levels) {
+            p->priority++;
+        }
+        p->mlfq_used = 0;
+    }
+    mlfq_boost(c, now);
+}
+
+// A thread that blocks on a semaphore before it used up the time of its level moves up a level
+static void mlfq_block(struct gt_carrier *c, struct gt *p) {
+    if (p->mlfq_used < mlfq_quantum_us(p->priority) && p->priority > 0) {
+        p->priority--;
+    }
+    p->mlfq_used = 0;
+}
+
+// A thread new to the MLFQ scheduler, or queued after a boost it missed, starts at the top level
+static void mlfq_attach(struct gt *p) {
+    mlfq_reset(p, 0);
+}
+
+static void mlfq_enqueue(struct gt_carrier *c, struct gt *p) {
+    if (p->mlfq_epoch < c->mlfq_epoch) {
+        mlfq_reset(p, c->mlfq_epoch);
+    }
+}
+
+// A woken thread preempts one running at a lower level
+static bool mlfq_wake(struct gt_carrier *c, struct gt *p) {
+    return p->priority < c->current->priority;
+}
+
+// Time slice of the running thread under the MLFQ scheduler: the time left at its level
+static long mlfq_slice_us(struct gt_carrier *c) {
+    struct gt *p = c->current;
+    return (long) (mlfq_quantum_us(p->priority) - p->mlfq_used);
+}
+
+// EDF tree orders: Ready threads by the deadline they are scheduled by, Throttled threads by the
+// start of their next period
+static bool edf_deadline_before(const struct gt *a, const struct gt *b) {
+    return a->edf_sched_deadline < b->edf_sched_deadline;
+}
+
+static bool edf_release_before(const struct gt *a, const struct gt *b) {
+    return a->edf_release < b->edf_release;
+}
+
+// Reserve EDF bandwidth on the first carrier it fits on, starting with the calling one. Admission
+// keeps the reserved densities (runtime / deadline) of a carrier within EDF_BANDWIDTH_PPM, which
+// lets EDF meet every deadline of the threads there as long as they stay within their runtime.
+static struct gt_carrier *edf_reserve(unsigned long bandwidth) {
+    struct gt_carrier *home = NULL;
+    spin_lock(&gt_edf_lock);
+    for (unsigned i = 0; i < gt_carrier_count && !home; i++) {
+        struct gt_carrier *c = &gt_carriers[(this_carrier()->index + i) % gt_carrier_count];
+        if (c->edf_bandwidth + bandwidth <= EDF_BANDWIDTH_PPM) {
+            c->edf_bandwidth += bandwidth;
+            home = c;
+        }
+    }
+    spin_unlock(&gt_edf_lock);
+    return home;
+}
+
+static void edf_unreserve(struct gt_carrier *c, unsigned long bandwidth) {
+    spin_lock(&gt_edf_lock);
+    c->edf_bandwidth -= bandwidth;
+    spin_unlock(&gt_edf_lock);
+}
+
+// Hold an EDF thread that ran out of runtime until its next period
+static void edf_throttle(struct gt_carrier *c, struct gt *p) {
+    p->metrics.edf_throttles++;
+    p->edf_release = p->edf_sched_deadline - p->edf_deadline + p->edf_period;
+    p->state = Throttled;
+    rb_insert(&c->edf_throttled, &p->rb_node, edf_release_before);
+}
+
+// Queue a Ready EDF thread on its carrier c, the calling one
+static void edf_enqueue(struct gt_carrier *c, struct gt *p) {
+    if (p->edf_budget <= 0) {
+        edf_throttle(c, p);
+        return;
+    }
+    p->state = Ready;
+    rb_insert(&c->edf_ready, &p->rb_node, edf_deadline_before);
+}
+
+// Make an EDF thread Ready on its own carrier, handed over by another carrier. A thread not running
+// before preempts the one running there, which may have a later deadline; the signal waits until
+// preemption is enabled again. A thread woken from a semaphore keeps its deadline and runtime only if
+// it cannot exceed its bandwidth with them (the CBS wake-up rule), otherwise its runtime is refilled
+// against a new deadline.
+static void edf_make_ready(struct gt *p) {
+    struct gt_carrier *c = this_carrier(), *home = p->carrier;
+    if (p->state == Blocked) {
+        unsigned long now = now_us();
+        unsigned long left = p->edf_sched_deadline > now ? p->edf_sched_deadline - now : 0;
+        if (left == 0 || (p->edf_budget > 0 && p->edf_budget * p->edf_deadline > left * p->edf_runtime)) {
+            p->edf_sched_deadline = now + p->edf_deadline;
+            p->edf_budget = p->edf_runtime;
+        }
+    }
+    bool preempt = p != c->current;
+    p->ready_tick = home->sched_ticks;
+    if (home == c) {
+        edf_enqueue(c, p);
+        preempt = preempt && p->state == Ready &&
+                  (!c->current->edf_runtime || edf_deadline_before(p, c->current));
+    } else {
+        p->state = Ready;
+        spin_lock(&home->edf_inbox_lock);
+        p->run_next = home->edf_inbox;
+        home->edf_inbox = p;
+        spin_unlock(&home->edf_inbox_lock);
+    }
+    if (preempt) {
+        pthread_kill(home->thread, SIGALRM);
+    }
+}
+
+// Next EDF thread of a carrier, the one with the earliest deadline, removed from the Ready tree.
+// Threads handed over by other carriers are queued first, and the Throttled threads whose period
+// started by now become Ready with a full runtime.
+static struct gt *edf_take_next(struct gt_carrier *c, const struct timeval *now) {
+    struct gt *p;
+    if (__atomic_load_n(&c->edf_inbox, __ATOMIC_RELAXED)) {
+        spin_lock(&c->edf_inbox_lock);
+        p = c->edf_inbox;
+        c->edf_inbox = NULL;
+        spin_unlock(&c->edf_inbox_lock);
+        while (p) {
+            struct gt *next = p->run_next;
+            edf_enqueue(c, p);
+            p = next;
+        }
+    }
+    while (c->edf_throttled.leftmost &&
+           (p = rb_thread(c->edf_throttled.leftmost))->edf_release <= timeval_us(now)) {
+        rb_erase(&c->edf_throttled, &p->rb_node);
+        p->edf_sched_deadline = p->edf_release + p->edf_deadline;
+        p->edf_budget = p->edf_runtime;
+        p->ready_tick = c->sched_ticks;
+        p->metrics.ready_start_time.tv_sec = p->edf_release / 1000000;
+        p->metrics.ready_start_time.tv_usec = p->edf_release % 1000000;
+        edf_enqueue(c, p);
+    }
+    if (!c->edf_ready.leftmost) {
+        return NULL;
+    }
+    p = rb_thread(c->edf_ready.leftmost);
+    rb_erase(&c->edf_ready, &p->rb_node);
+    return p;
+}
+
+// Microseconds until the next Throttled EDF thread of a carrier becomes Ready, limit if none does before
+static long edf_next_release_us(struct gt_carrier *c, long limit) {
+    if (!c->edf_throttled.leftmost) {
+        return limit;
+    }
+    unsigned long release = rb_thread(c->edf_throttled.leftmost)->edf_release, now = now_us();
+    if (release <= now) {
+        return 0;
+    }
+    return release - now < (unsigned long) limit ? (long) (release - now) : limit;
+}
+
+// Put a thread under the policy of a carrier, unless it already is: new threads, threads from a
+// carrier that did not switch policies yet, and the Ready threads of a carrier that switches. Each
+// policy starts from the priority the thread was created with.
+static void sched_attach(struct gt_carrier *c, struct gt *p) {
+    if (p->sched != c->sched) {
+        p->sched = c->sched;
+        p->priority = p->original_priority;
+        if (p->sched->attach) {
+            p->sched->attach(p);
+        }
+    }
+}
+
+// Append a Ready thread to the run queue of its priority on a carrier, and hand it to the policy
+static void run_queue_append(struct gt_carrier *c, struct gt *p) {
+    sched_attach(c, p);
+    if (c->sched->enqueue) {
+        c->sched->enqueue(c, p); // may set the priority
+    }
+    struct gt_run_queue *queue = &c->run_queues[p->priority];
+    p->carrier = c;
+    p->run_next = NULL;
+    p->run_prev = queue->tail;
+    if (queue->tail) {
+        queue->tail->run_next = p;
+    } else {
+        queue->head = p;
+    }
+    queue->tail = p;
+    c->ready_bitmap |= 1u << p->priority;
+    c->nr_ready++;
+}
+
+// Mark a thread Ready and queue it on the calling carrier
+static void make_ready(struct gt *p) {
+    if (p->edf_runtime) {
+        edf_make_ready(p);
+        return;
+    }
+    struct gt_carrier *c = this_carrier();
+    p->state = Ready;
+    p->ready_tick = c->sched_ticks;
+    run_queue_append(c, p);
+}
+
+// Let the policy decide whether a thread just woken on the calling carrier runs before the current
+// one. The tick is taken once preemption is enabled again.
+static void wake_preempt(struct gt *p) {
+    struct gt_carrier *c = this_carrier();
+    if (!p->edf_runtime && !c->current->edf_runtime && c->sched->on_wake && c->sched->on_wake(c, p)) {
+        pthread_kill(c->thread, SIGALRM);
+    }
+}
+
+// Unlink a Ready thread from the run queue of its carrier and take it from the policy
+static void run_queue_remove(struct gt *p) {
+    struct gt_carrier *c = p->carrier;
+    struct gt_run_queue *queue = &c->run_queues[p->priority];
+    if (p->run_prev) {
+        p->run_prev->run_next = p->run_next;
+    } else {
+        queue->head = p->run_next;
+    }
+    if (p->run_next) {
+        p->run_next->run_prev = p->run_prev;
+    } else {
+        queue->tail = p->run_prev;
+    }
+    if (!queue->head) {
+        c->ready_bitmap &= ~(1u << p->priority);
+    }
+    c->nr_ready--;
+    if (c->sched->dequeue) {
+        c->sched->dequeue(c, p);
+    }
+}
+
+// Take back the threads no other carrier stole, the policy chooses among all of them again. They
+// keep their ready_tick, so aging goes on while a thread is offered.
+static void reclaim_offered(struct gt_carrier *c) {
+    struct gt *p;
+    while ((p = deque_pop(&c->deque))) {
+        run_queue_append(c, p);
+    }
+}
+
+// Offer the threads this carrier would run last, one for each carrier that is idle. Busy carriers
+// do not steal and an offered thread misses the picks of its own carrier: were threads offered
+// while no carrier waits for them, the one run last could be offered and reclaimed every round.
+static void offer_surplus(struct gt_carrier *c) {
+    unsigned idle = __atomic_load_n(&gt_idle_carriers, __ATOMIC_RELAXED);
+    for (unsigned offered = 0; offered < idle && c->nr_ready > 0; offered++) {
+        struct gt *p = c->run_queues[31 - __builtin_clz(c->ready_bitmap)].tail;
+        run_queue_remove(p);
+        if (!deque_push(&c->deque, p)) {
+            run_queue_append(c, p);
+            break;
+        }
     }
 }
 
 // Semaphore initialization
 void gt_sem_init(gt_semaphore_t* sem, int initial_value) {
     sem->value = initial_value;
+    sem->lock = 0;
     sem->wait_count = 0;
-    sem->head = 0;
-    sem->tail = 0;
+    sem->wait_head = NULL;
+    sem->wait_tail = NULL;
 }
 
 // P operation (wait)
 void gt_sem_wait(gt_semaphore_t* sem) {
+    sigset_t saved;
+    preempt_disable(&saved);
+    spin_lock(&sem->lock);
     sem->value--;
     
     if (sem->value < 0) {
         // Need to block the current thread
-        // Use a safer approach to get the thread's info
-        const char* label = "Thread";
-        int id = 0;
-        
-        // Find the thread in thread_params by using the thread's index in gt_table
-        for (int i = 0; i < MAX_G_THREADS; i++) {
-            if (gt_current == &gt_table[i]) {
-                label = thread_params[i].label;
-                id = thread_params[i].id;
-                break;
-            }
-        }
-        
-        printf("%s priority thread id = %d BLOCKED on semaphore\n", label, id);
+        printf("%s priority thread id = %d BLOCKED on semaphore\n", thread_label(gt_current),
+               thread_label_id(gt_current));
                
         // Add thread to the semaphore wait queue
-        sem->wait_queue[sem->tail] = gt_current;
-        sem->tail = (sem->tail + 1) % MAX_BLOCKED_THREADS;
+        gt_current->run_next = NULL;
+        if (sem->wait_tail) {
+            sem->wait_tail->run_next = gt_current;
+        } else {
+            sem->wait_head = gt_current;
+        }
+        sem->wait_tail = gt_current;
         sem->wait_count++;
+        __atomic_add_fetch(&gt_blocked_threads, 1, __ATOMIC_RELAXED);
         
         // Mark thread as blocked
         gt_current->state = Blocked;
         
-        // Force a context switch
-        gt_schedule();
+        // Force a context switch. The lock is released once our context is saved, a gt_sem_post()
+        // on another carrier cannot resume this thread before.
+        schedule(&sem->lock);
+        return;
     }
+    spin_unlock(&sem->lock);
+    preempt_restore(&saved);
 }
 
 // V operation (signal)
 void gt_sem_post(gt_semaphore_t* sem) {
+    sigset_t saved;
+    struct gt *thread_to_wake = NULL;
+    preempt_disable(&saved);
+    spin_lock(&sem->lock);
     sem->value++;
     
     if (sem->value <= 0 && sem->wait_count > 0) {
-        // Wake up a waiting thread
-        struct gt *thread_to_wake = sem->wait_queue[sem->head];
-        sem->head = (sem->head + 1) % MAX_BLOCKED_THREADS;
+        // Wake up a waiting thread, it continues on this carrier
+        thread_to_wake = sem->wait_head;
+        sem->wait_head = thread_to_wake->run_next;
+        if (!sem->wait_head) {
+            sem->wait_tail = NULL;
+        }
         sem->wait_count--;
+        __atomic_sub_fetch(&gt_blocked_threads, 1, __ATOMIC_RELAXED);
         
         // Move thread from Blocked to Ready state
-        thread_to_wake->state = Ready;
         gettimeofday(&thread_to_wake->metrics.ready_start_time, NULL);
-        
-        // Use a safer approach to get the thread's info
-        const char* label = "Thread";
-        int id = 0;
-        
-        // Find the thread in thread_params by using the thread's index in gt_table
-        for (int i = 0; i < MAX_G_THREADS; i++) {
-            if (thread_to_wake == &gt_table[i]) {
-                label = thread_params[i].label;
-                id = thread_params[i].id;
-                break;
-            }
-        }
-        
-        printf("%s priority thread id = %d UNBLOCKED from semaphore\n", label, id);
+        make_ready(thread_to_wake);
+        wake_preempt(thread_to_wake);
     }
-}
-
-// Get a thread using lottery scheduling algorithm
-static struct gt* lottery_schedule() {
-    ensure_random_initialized();
+    spin_unlock(&sem->lock);
     
-    // Count total tickets of all Ready threads
-    int total_tickets = 0;
-    struct gt *p;
-    for (p = &gt_table[0]; p < &gt_table[MAX_G_THREADS]; p++) {
-        if (p->state == Ready) {
-            total_tickets += p->tickets;
-        }
+    if (thread_to_wake) {
+        printf("%s priority thread id = %d UNBLOCKED from semaphore\n", thread_label(thread_to_wake),
+               thread_label_id(thread_to_wake));
     }
-    
-    // If no tickets (no ready threads), return NULL
+    preempt_restore(&saved);
+}
+
+// Get a thread using lottery scheduling among the carrier's Ready threads: draw a ticket and descend
+// the Fenwick tree to the slot holding it, O(log n)
+static struct gt* lottery_schedule(struct gt_carrier *c) {
+    // The root of the tree covers every slot
+    long total_tickets = c->slot_count ? c->lottery_tree[c->lottery_capacity] : 0;
     if (total_tickets == 0) {
         return NULL;
     }
     
-    // Select a random ticket
-    int winning_ticket = rand() % total_tickets;
+    // Select a random ticket, scaled without the bias of a modulo
+    long winning_ticket = (long) (((unsigned __int128) carrier_random(c) * total_tickets) >> 64);
     
-    // Find the thread that owns this ticket
-    int ticket_counter = 0;
-    for (p = &gt_table[0]; p < &gt_table[MAX_G_THREADS]; p++) {
-        if (p->state == Ready) {
-            ticket_counter += p->tickets;
-            if (winning_ticket < ticket_counter) {
-                return p;
-            }
+    // Find the last slot whose prefix sum does not exceed the ticket, the next slot holds it
+    unsigned slot = 0;
+    for (unsigned step = c->lottery_capacity; step; step >>= 1) {
+        if (slot + step <= c->lottery_capacity && c->lottery_tree[slot + step] <= winning_ticket) {
+            slot += step;
+            winning_ticket -= c->lottery_tree[slot];
         }
     }
-    
-    // Should never reach here if we have ready threads
-    return NULL;
+    return c->ready_slots[slot];
 }
 
-// Get a thread using simple round-robin scheduling
-static struct gt* round_robin_schedule() {
-    static int round_robin_index = 0;
-    struct gt *p;
-    int start_idx = (round_robin_index + 1) % MAX_G_THREADS;
-    
-    for (int i = 0; i < MAX_G_THREADS; i++) {
-        int idx = (start_idx + i) % MAX_G_THREADS;
-        p = &gt_table[idx];
-        if (p->state == Ready) {
-            round_robin_index = idx;
-            return p;
-        }
+// Get a thread using stride scheduling: the carrier's Ready thread with the lowest pass. It is charged
+// its stride right away; a thread holding n tickets is picked n times as often as one holding a
+// single ticket, with an error of at most one pick.
+static struct gt* stride_schedule(struct gt_carrier *c) {
+    if (c->slot_count == 0) {
+        return NULL;
     }
-    
-    return NULL;
+    struct gt *p = c->ready_slots[0];
+    c->stride_pass = p->pass;
+    p->pass += p->stride; // p leaves the heap next, its key may change
+    return p;
+}
+
+// Get a thread using fair scheduling: the carrier's Ready thread with the lowest vruntime
+static struct gt* fair_schedule(struct gt_carrier *c) {
+    if (!c->fair_tree.leftmost) {
+        return NULL;
+    }
+    struct gt *p = rb_thread(c->fair_tree.leftmost);
+    if (p->vruntime > c->min_vruntime) {
+        c->min_vruntime = p->vruntime;
+    }
+    return p;
 }
 
-// Get a thread using priority-based scheduling with starvation prevention
-static struct gt* priority_schedule() {
-    static int round_robin_index = 0;
-    bool thread_found = false;
+// Get a thread using the multi-level feedback queue: the first thread of the highest non-empty level
+static struct gt* mlfq_schedule(struct gt_carrier *c) {
+    return c->ready_bitmap ? c->run_queues[__builtin_ctz(c->ready_bitmap)].head : NULL;
+}
+
+// Get a thread using round-robin scheduling: the carrier's thread that has been Ready the longest,
+// found among the heads of the run queues regardless of priority
+static struct gt* round_robin_schedule(struct gt_carrier *c) {
     struct gt *selected_thread = NULL;
-    struct gt *p;
-    int max_starvation = -1;  // Track the thread with the most starvation
     
-    // First, check if any thread has critical starvation (force it to run)
-    for (p = &gt_table[0]; p < &gt_table[MAX_G_THREADS]; p++) {
-        if (p->state == Ready && p->starvation_count > 10 && p->starvation_count > max_starvation) {
+    for (uint32_t levels = c->ready_bitmap; levels; levels &= levels - 1) {
+        struct gt *p = c->run_queues[__builtin_ctz(levels)].head;
+        if (!selected_thread || p->ready_tick < selected_thread->ready_tick) {
             selected_thread = p;
-            max_starvation = p->starvation_count;
-            thread_found = true;
         }
     }
     
-    // If no critically starving thread, use priority-based scheduling
-    if (!thread_found) {
-        // Use round-robin within each priority level for fairness
-        // Start searching from the thread after the last scheduled one
-        int start_idx = (round_robin_index + 1) % MAX_G_THREADS;
-        
-        // First search loop - look for highest priority thread starting from round_robin_index
-        for (int current_priority = MIN_PRIORITY; current_priority <= MAX_PRIORITY && !thread_found; current_priority++) {
-            for (int i = 0; i < MAX_G_THREADS && !thread_found; i++) {
-                int idx = (start_idx + i) % MAX_G_THREADS;
-                p = &gt_table[idx];
-                if (p->state == Ready && p->priority == current_priority) {
-                    selected_thread = p;
-                    round_robin_index = idx;  // Update for next scheduling decision
-                    thread_found = true;
-                }
-            }
+    return selected_thread;
+}
+
+// Get a thread using priority-based scheduling with starvation prevention. Only the head of each
+// non-empty run queue is considered: it has waited longest at its priority and so has aged the most.
+// The cost depends on the number of priority levels, not on the number of threads.
+static struct gt* priority_schedule(struct gt_carrier *c) {
+    struct gt *selected_thread = NULL;
+    int selected_priority = INT_MAX;
+    int selected_starvation = -1;
+
+    for (uint32_t levels = c->ready_bitmap; levels; levels &= levels - 1) {
+        struct gt *p = c->run_queues[__builtin_ctz(levels)].head;
+        int priority = effective_priority(p);
+        int starvation = thread_starvation(p);
+        // Among critically starving threads the one that waited longest wins
+        if (priority < selected_priority ||
+            (priority == MIN_PRIORITY - 1 && starvation > selected_starvation)) {
+            selected_thread = p;
+            selected_priority = priority;
+            selected_starvation = starvation;
         }
     }
-    
+
     return selected_thread;
 }
 
-// Update starvation counters and adjust priorities
-static void update_starvation_counters() {
-    struct gt *p;
-    
-    // First reset starvation counter for current thread if it was running
-    if (gt_current->state == Running) {
-        gt_current->starvation_count = 0;
-        
-        // Reset the thread's priority to its original value if using priority scheduler
-        if (gt_current_scheduler == GT_SCHED_PRI) {
-            gt_current->priority = gt_current->original_priority;
-        }
+static const struct gt_sched_ops rr_ops = {
+    .name = "Round Robin",
+    .pick_next = round_robin_schedule,
+};
+
+static const struct gt_sched_ops pri_ops = {
+    .name = "Priority-based",
+    .aging = true,
+    .pick_next = priority_schedule,
+};
+
+static const struct gt_sched_ops lottery_ops = {
+    .name = "Lottery Scheduling",
+    .compete = true,
+    .enqueue = lottery_insert,
+    .dequeue = lottery_remove,
+    .pick_next = lottery_schedule,
+};
+
+static const struct gt_sched_ops stride_ops = {
+    .name = "Stride Scheduling",
+    .compete = true,
+    .attach = stride_attach,
+    .enqueue = stride_insert,
+    .dequeue = stride_remove,
+    .pick_next = stride_schedule,
+};
+
+static const struct gt_sched_ops fair_ops = {
+    .name = "Fair Scheduling",
+    .compete = true,
+    .enqueue = fair_insert,
+    .dequeue = fair_remove,
+    .pick_next = fair_schedule,
+    .tick = fair_tick,
+    .on_wake = fair_wake,
+    .slice_us = fair_slice_us,
+};
+
+static const struct gt_sched_ops mlfq_ops = {
+    .name = "Multi-level Feedback Queue",
+    .compete = true,
+    .attach = mlfq_attach,
+    .enqueue = mlfq_enqueue,
+    .pick_next = mlfq_schedule,
+    .tick = mlfq_tick,
+    .on_block = mlfq_block,
+    .on_wake = mlfq_wake,
+    .slice_us = mlfq_slice_us,
+};
+
+// Policy of each gt_scheduler_type
+static const struct gt_sched_ops *const gt_policies[GT_SCHED_COUNT] = {
+    [GT_SCHED_RR] = &rr_ops,
+    [GT_SCHED_PRI] = &pri_ops,
+    [GT_SCHED_LS] = &lottery_ops,
+    [GT_SCHED_STRIDE] = &stride_ops,
+    [GT_SCHED_FAIR] = &fair_ops,
+    [GT_SCHED_MLFQ] = &mlfq_ops,
+};
+
+// Follow gt_set_scheduler() on a carrier: its Ready threads leave the structures of the old policy and
+// join those of the new one, in the order they became Ready. Offered threads switch when they are
+// reclaimed or stolen.
+static void sched_switch(struct gt_carrier *c) {
+    const struct gt_sched_ops *sched = gt_policies[__atomic_load_n(&gt_current_scheduler, __ATOMIC_RELAXED)];
+    if (c->sched == sched) {
+        return;
     }
-    
-    // Increment starvation counter for all Ready threads
-    for (p = &gt_table[0]; p < &gt_table[MAX_G_THREADS]; p++) {
-        if (p->state == Ready) {
-            p->starvation_count++;
-            
-            // Only adjust priority dynamically for priority-based scheduling
-            if (gt_current_scheduler == GT_SCHED_PRI) {
-                // The more it starves, the higher its priority becomes
-                // Starving threads now get priority boost much faster
-                int new_priority = p->original_priority - p->starvation_count;
-                if (new_priority < MIN_PRIORITY) new_priority = MIN_PRIORITY;
-                p->priority = new_priority;
-                
-                // If a thread has been starving for too long, force it to run next
-                if (p->starvation_count > 10) {
-                    // Super boost - give it highest priority plus a bonus
-                    p->priority = MIN_PRIORITY - 1;  // Even higher than normal highest priority
-                }
-            }
-        }
+    struct gt *ready = NULL, **tail = &ready;
+    while (c->ready_bitmap) {
+        struct gt *p = round_robin_schedule(c); // the longest Ready
+        run_queue_remove(p);
+        *tail = p;
+        tail = &p->run_next;
+    }
+    *tail = NULL;
+    c->sched = sched;
+    while (ready) {
+        struct gt *p = ready;
+        ready = p->run_next;
+        run_queue_append(c, p);
     }
 }
 
-// Update thread metrics when it's about to stop running
+// Update thread metrics when it's about to stop running, also when it stops because it blocked
 static void update_running_thread_metrics(struct timeval *switch_time) {
-    if (gt_current->state == Running) {
+    if (gt_current->state == Running || gt_current->state == Blocked || gt_current->state == Throttled) {
         unsigned long exec_time = time_elapsed_us(&gt_current->metrics.exec_start_time, switch_time);
         gt_current->metrics.exec_total_time += exec_time;
         gt_current->metrics.exec_periods++;
+        struct gt_carrier *c = this_carrier();
+        if (gt_current->edf_runtime) {
+            gt_current->edf_budget -= exec_time;
+        } else if (c->sched->tick) {
+            c->sched->tick(c, gt_current, exec_time, switch_time);
+        }
         
         // Update min/max/sum metrics
         if (exec_time < gt_current->metrics.exec_shortest) {
@@ -293,21 +1292,14 @@ void gt_print_stats(int sig) {
     gettimeofday(&current_time, NULL);
     
     printf("\n================ Thread Performance Report ================\n");
-    const char* scheduler_name;
-    switch (gt_current_scheduler) {
-        case GT_SCHED_RR: scheduler_name = "Round Robin"; break;
-        case GT_SCHED_PRI: scheduler_name = "Priority-based"; break;
-        case GT_SCHED_LS: scheduler_name = "Lottery Scheduling"; break;
-        default: scheduler_name = "Unknown";
-    }
-    printf("Current scheduler: %s\n\n", scheduler_name);
+    printf("Current scheduler: %s\n\n", gt_policies[gt_current_scheduler]->name);
     
     printf("%-4s | %-8s | %-8s | %-8s | %-8s | %-12s | %-12s | %-10s | %-10s\n", 
            "ID", "Status", "Priority", "Original", "Tickets", "Exec Time(μs)", "Wait Time(μs)", "Avg Exec", "Avg Wait");
     printf("---------------------------------------------------------------------------------\n");
     
-    for (int i = 0; i < MAX_G_THREADS; i++) {
-        struct gt *thread = &gt_table[i];
+    for (unsigned i = 0; i < gt_thread_count; i++) {
+        struct gt *thread = gt_thread(i);
         
         // Skip completely unused threads
         if (thread->state == Unused && thread->metrics.exec_periods == 0) {
@@ -340,18 +1332,19 @@ void gt_print_stats(int sig) {
         const char *state_str = 
             thread->state == Running ? "Running" : 
             thread->state == Ready ? "Ready" : 
-            thread->state == Blocked ? "Blocked" : "Unused";
+            thread->state == Blocked ? "Blocked" :
+            thread->state == Throttled ? "Throttled" : "Unused";
         
-        printf("%-4d | %-8s | %-8d | %-8d | %-8d | %-12lu | %-12lu | %-10.2f | %-10.2f\n", 
+        printf("%-4u | %-8s | %-8d | %-8d | %-8d | %-12lu | %-12lu | %-10.2f | %-10.2f\n", 
                i, state_str, 
-               thread->priority, thread->original_priority,
+               effective_priority(thread), thread->original_priority,
                thread->tickets,
                total_exec, total_wait, avg_exec, avg_wait);
     }
     
     printf("\n--- Detailed Statistics ---\n");
-    for (int i = 0; i < MAX_G_THREADS; i++) {
-        struct gt *thread = &gt_table[i];
+    for (unsigned i = 0; i < gt_thread_count; i++) {
+        struct gt *thread = gt_thread(i);
         if (thread->state != Unused || thread->metrics.exec_periods > 0) {
             // Calculate variance if we have enough data points
             double exec_variance = 0;
@@ -366,9 +1359,9 @@ void gt_print_stats(int sig) {
                 wait_variance = ((double)thread->metrics.wait_time_sq_sum / thread->metrics.wait_periods) - (avg * avg);
             }
             
-            printf("Thread %d:\n", i);
+            printf("Thread %u:\n", i);
             printf("  Priority: %d (Original: %d), Tickets: %d, Starvation count: %d\n", 
-                   thread->priority, thread->original_priority, thread->tickets, thread->starvation_count);
+                   effective_priority(thread), thread->original_priority, thread->tickets, thread_starvation(thread));
             printf("  RSP: 0x%lx\n", thread->ctx.rsp);
             printf("  Execution: min=%lu μs, max=%lu μs, periods=%u, variance=%.2f\n",
                    thread->metrics.exec_shortest == ULONG_MAX ? 0 : thread->metrics.exec_shortest,
@@ -380,176 +1373,515 @@ void gt_print_stats(int sig) {
                    thread->metrics.wait_longest,
                    thread->metrics.wait_periods,
                    wait_variance);
+            if (thread->edf_runtime) {
+                printf("  EDF: runtime=%lu μs, period=%lu μs, deadline=%lu μs, jobs=%u, deadline misses=%u, throttled=%u\n",
+                       thread->edf_runtime, thread->edf_period, thread->edf_deadline,
+                       thread->metrics.edf_jobs, thread->metrics.edf_deadline_misses,
+                       thread->metrics.edf_throttles);
+            }
         }
     }
     printf("===============================================================\n");
 }
 
-// Set the current scheduler type for initialization in main.c
+// Set the scheduler type, before gt_init() or while threads run. Each carrier moves its threads to the
+// new policy at its next scheduling round, see sched_switch().
 void gt_set_scheduler(enum gt_scheduler_type sched_type) {
-    gt_current_scheduler = sched_type;
+    if ((unsigned) sched_type >= GT_SCHED_COUNT) {
+        fprintf(stderr, "Error: Unknown scheduler type\n");
+        return;
+    }
+    __atomic_store_n(&gt_current_scheduler, sched_type, __ATOMIC_RELAXED);
+}
+
+// Enable or disable returning the pages of pooled stacks to the kernel
+void gt_set_stack_trim(bool trim) {
+    gt_stack_trim = trim;
+}
+
+// Next thread for a carrier, already removed from where it was queued: its EDF thread with the earliest
+// deadline, otherwise chosen by the scheduling policy among the carrier's own threads, otherwise one
+// offered by this or another carrier
+static struct gt *take_next(struct gt_carrier *c, const struct timeval *now) {
+    struct gt *p = edf_take_next(c, now); // EDF threads take precedence over the policy
+    if (p) {
+        return p;
+    }
+    if ((p = c->sched->pick_next(c))) {
+        run_queue_remove(p);
+        return p;
+    }
+
+    if (gt_carrier_count > 1 && (p = deque_pop(&c->deque))) {
+        return p;
+    }
+    for (unsigned i = 1; i < gt_carrier_count; i++) {
+        if ((p = deque_steal(&gt_carriers[(c->index + i) % gt_carrier_count].deque))) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+// Complete a switch on the side of the thread switched to, once nothing runs on the previous thread
+// any more: release its stack if it exited, release the lock of the semaphore it blocked on
+static void finish_switch(void) {
+    struct gt_carrier *c = this_carrier();
+    struct gt *prev = c->prev;
+    c->prev = NULL;
+    if (prev && prev != &c->idle) {
+        if (prev->state == Unused) {
+            spin_lock(&gt_alloc_lock);
+            stack_release(prev->stack, prev->stack_size);
+            prev->stack = NULL;
+            free_thread(prev); // its ID is reused by gt_create
+            spin_unlock(&gt_alloc_lock);
+        }
+    }
+    if (c->unlock) {
+        spin_unlock(c->unlock);
+        c->unlock = NULL;
+    }
+}
+
+// Make p the running thread of carrier c and switch to it from prev. unlock is released by
+// finish_switch() once prev's context is saved.
+static void switch_to(struct gt_carrier *c, struct gt *prev, struct gt *p, int *unlock) {
+    c->prev = prev;
+    c->unlock = unlock;
+    c->current = p;
+    p->carrier = c;
+    gt_switch(&prev->ctx, &p->ctx); // perform context switch (assembly in gtswtch.S)
+}
+
+// Idle context of a carrier, running when none of its threads can: waits for a thread of its own
+// or one offered by another carrier and switches to it. Preemption stays disabled in here.
+static void carrier_idle(void) {
+    struct gt_carrier *c = this_carrier(); // the idle context never changes carriers
+    static const struct itimerspec disarm;
+    while (true) {
+        finish_switch();
+        timer_settime(c->timer, 0, &disarm, NULL); // no time slices while idle
+        sched_switch(c);
+
+        struct timeval switch_time;
+        gettimeofday(&switch_time, NULL);
+        struct gt *p = take_next(c, &switch_time);
+        if (!p) {
+            __atomic_add_fetch(&gt_idle_carriers, 1, __ATOMIC_RELAXED); // busy carriers offer more threads
+            for (long backoff_ns = 1000; !p; backoff_ns = backoff_ns < 1000000 ? backoff_ns * 2 : backoff_ns) {
+                gt_uninterruptible_nanosleep(0, edf_next_release_us(c, backoff_ns / 1000) * 1000);
+                gettimeofday(&switch_time, NULL);
+                p = take_next(c, &switch_time);
+            }
+            __atomic_sub_fetch(&gt_idle_carriers, 1, __ATOMIC_RELAXED);
+        }
+
+        sched_attach(c, p); // stolen threads may come from a carrier that did not switch policies yet
+        update_ready_thread_metrics(p, &switch_time);
+        p->state = Running;
+        p->metrics.exec_start_time = switch_time;
+        switch_to(c, &c->idle, p, NULL);
+    }
+}
+
+// Create the preemption timer of the calling carrier, its SIGALRM goes to this kernel thread only
+static void create_carrier_timer(struct gt_carrier *c) {
+    struct sigevent event = {0};
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = SIGALRM;
+    event._sigev_un._tid = gettid();
+    if (timer_create(CLOCK_MONOTONIC, &event, &c->timer) == -1) {
+        perror("timer_create");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Body of the carrier kernel threads started by gt_init()
+static void *carrier_main(void *arg) {
+    struct gt_carrier *c = arg;
+    gt_this_carrier = c;
+    create_carrier_timer(c);
+    c->current = &c->idle; // the idle context runs on the kernel thread's own stack
+    carrier_idle();
+    return NULL;
+}
+
+// Seed the lottery draws with a fixed value, runs with the same seed draw the same tickets
+void gt_set_random_seed(uint64_t seed) {
+    gt_random_seed = seed;
+    gt_random_seeded = true;
+}
+
+// Configure the MLFQ scheduler, before gt_init(): the number of levels (1 to MAX_PRIORITY + 1,
+// 0 = MLFQ_LEVELS), the time a thread may use at each level (NULL or 0 = TIME_SLICE_US doubling from
+// level to level) and the interval of the priority boost (0 = MLFQ_BOOST_US)
+void gt_set_mlfq(unsigned levels, const unsigned long *quantum_us, unsigned long boost_us) {
+    if (levels == 0) {
+        levels = MLFQ_LEVELS;
+    }
+    if (levels > MAX_PRIORITY + 1) {
+        levels = MAX_PRIORITY + 1;
+    }
+    gt_mlfq_levels = levels;
+    for (unsigned i = 0; i < levels; i++) {
+        gt_mlfq_quantum_us[i] = quantum_us ? quantum_us[i] : 0;
+    }
+    gt_mlfq_boost_us = boost_us ? boost_us : MLFQ_BOOST_US;
+}
+
+// Set the number of carrier kernel threads, before gt_init()
+void gt_set_carriers(unsigned count) {
+    gt_carrier_count = count;
 }
 
 // initialize first thread as current context
 void gt_init(void) {
-	gt_current = &gt_table[0]; // initialize current thread with thread #0
+	unsigned count = gt_carrier_count ? gt_carrier_count : (unsigned) sysconf(_SC_NPROCESSORS_ONLN);
+	gt_carriers = aligned_alloc(__alignof__(struct gt_carrier), count * sizeof(struct gt_carrier));
+	if (!gt_carriers) {
+		perror("gt_init");
+		exit(EXIT_FAILURE);
+	}
+	memset(gt_carriers, 0, count * sizeof(struct gt_carrier));
+	gt_carrier_count = count;
+	unsigned long mlfq_epoch = now_us() / gt_mlfq_boost_us; // threads start at the top MLFQ level
+	for (unsigned i = 0; i < count; i++) {
+		gt_carriers[i].index = i;
+		gt_carriers[i].idle.state = Running;
+		gt_carriers[i].mlfq_epoch = mlfq_epoch;
+		gt_carriers[i].sched = gt_policies[gt_current_scheduler];
+	}
+
+	// The calling kernel thread becomes carrier 0, running the main thread
+	struct gt_carrier *c = &gt_carriers[0];
+	gt_this_carrier = c;
+	c->thread = pthread_self();
+	c->current = alloc_thread(); // initialize current thread with thread #0
+	if (!c->current) {
+		perror("gt_init");
+		exit(EXIT_FAILURE);
+	}
 	gt_current->state = Running; // set current to running
+	gt_current->carrier = c;
+	gt_live_threads = 1;
 	
 	// Initialize metrics for the main thread
 	init_thread_metrics(&gt_current->metrics);
 	
 	// Initialize tickets for the main thread (if we're using lottery scheduling)
 	gt_current->tickets = gt_current->tickets > 0 ? gt_current->tickets : 1; // Ensure at least 1 ticket
+	sched_attach(c, gt_current);
 	
-	// Initialize random generator for lottery scheduling
-	ensure_random_initialized();
+	// Carrier 0's idle context needs a stack of its own, the main thread keeps the process stack
+	char *stack = stack_alloc(stack_class_size(IDLE_STACK_SIZE));
+	if (!stack) {
+		perror("gt_init");
+		exit(EXIT_FAILURE);
+	}
+	char *top = stack + STACK_GUARD_SIZE + stack_class_size(IDLE_STACK_SIZE);
+	*(uint64_t *) (top - 16) = (uint64_t) carrier_idle; // entered on the first switch to it, never returns
+	c->idle.ctx.rsp = (uint64_t) (top - 16);
+	create_carrier_timer(c);
+
+	// Initialize the random generators for lottery scheduling
+	uint64_t seed = gt_random_seeded ? gt_random_seed : (uint64_t) time(NULL);
+	for (unsigned i = 0; i < count; i++) {
+		seed_random(&gt_carriers[i], seed);
+	}
 	
-	signal(SIGALRM, gt_alarm_handle); // register SIGALRM, signal from timer generated by alarm
+	signal(SIGALRM, gt_alarm_handle); // register SIGALRM, signal from the carrier timers
 	signal(SIGINT, gt_print_stats);   // register SIGINT handler for statistics display
+
+	// The other carriers start with preemption disabled, it is enabled when they run a thread
+	sigset_t saved;
+	preempt_disable(&saved);
+	for (unsigned i = 1; i < count; i++) {
+		int err = pthread_create(&gt_carriers[i].thread, NULL, carrier_main, &gt_carriers[i]);
+		if (err) {
+			fprintf(stderr, "gt_init: cannot start carrier %u: %s\n", i, strerror(err));
+			exit(EXIT_FAILURE);
+		}
+	}
+	preempt_restore(&saved);
 }
 
 // exit thread
 void __attribute__((noreturn)) gt_return(int ret) {
-	if (gt_current != &gt_table[0]) {
+	if (gt_current->id != 0) {
 		// if not an initial thread
+		preempt_disable(NULL); // the thread must not be preempted once it is Unused
 		struct timeval exit_time;
 		gettimeofday(&exit_time, NULL);
 		
 		// Update final execution time
 		unsigned long exec_time = time_elapsed_us(&gt_current->metrics.exec_start_time, &exit_time);
 		gt_current->metrics.exec_total_time += exec_time;
+		__atomic_sub_fetch(&gt_live_threads, 1, __ATOMIC_RELAXED);
+		if (gt_current->edf_runtime) {
+			edf_unreserve(gt_current->carrier, gt_current->edf_bandwidth);
+		}
 		
-		gt_current->state = Unused; // set current thread as unused
-		free((void *) (gt_current->ctx.rsp + 16)); // free the stack
-		gt_schedule(); // yield and make possible to switch to another thread
+		// The thread still runs on its stack, finish_switch() releases it after the switch away
+		gt_current->state = Unused;
+		schedule(NULL); // switch to another thread
 		assert(!"reachable");
 		// this code should never be reachable ... (if yes, returning function on stack was corrupted)
 	}
-	while (gt_schedule()); // if initial thread, wait for other to terminate
+	// if initial thread, wait until every other thread terminated or is blocked
+	while (__atomic_load_n(&gt_live_threads, __ATOMIC_RELAXED) >
+	       1 + __atomic_load_n(&gt_blocked_threads, __ATOMIC_RELAXED)) {
+		if (!gt_schedule()) {
+			sched_yield(); // the remaining threads run on other carriers
+		}
+	}
 	exit(ret);
 }
 
-// switch from one thread to other
-bool gt_schedule(void) {
-	struct gt *p;
-	struct gt_context *old, *new;
+// switch from the current thread to the next one chosen for this carrier, see gt_schedule()
+static bool schedule(int *unlock) {
+	struct gt_carrier *c;
+	struct gt *prev, *p;
 	struct timeval switch_time;
 	gettimeofday(&switch_time, NULL);
 
-	gt_reset_sig(SIGALRM); // reset signal
+	preempt_disable(NULL); // the run queues must not change under us, see gt_reset_sig() below
+	c = this_carrier(); // read with preemption disabled, we stay on this carrier until the switch
+	prev = c->current;
+	c->sched_ticks++;
+	sched_switch(c);
+	sched_attach(c, prev);
 
-	// Update metrics for the current running thread
+	// Update metrics for the current running thread, the policy charges its run
 	update_running_thread_metrics(&switch_time);
+	if (prev->state == Running && prev->edf_runtime && prev->edf_budget <= 0) {
+		edf_throttle(c, prev);
+	}
+	if (prev->state == Blocked && !prev->edf_runtime && c->sched->on_block) {
+		c->sched->on_block(c, prev);
+	}
 
-	// Update starvation counters and adjust priorities
-	update_starvation_counters();
-	
-    // Choose next thread to run based on current scheduler type
-    p = NULL;
-    switch (gt_current_scheduler) {
-        case GT_SCHED_RR:
-            p = round_robin_schedule();
-            break;
-            
-        case GT_SCHED_PRI:
-            p = priority_schedule();
-            break;
-            
-        case GT_SCHED_LS:
-            p = lottery_schedule();
-            break;
-            
-        default:
-            fprintf(stderr, "Error: Unknown scheduler type\n");
-            return false;
-    }
-	
-	// If no Ready thread was found, return false
-	if (!p) {
-		return false;
+	if (gt_carrier_count > 1) {
+		reclaim_offered(c);
+		offer_surplus(c); // before prev is queued, a thread still running cannot be stolen
 	}
 
-	// Update wait time for the thread that's about to run
-	update_ready_thread_metrics(p, &switch_time);
+	// Under the proportional-share policies a yielding or preempted thread competes with the others,
+	// its share is counted over every pick or, for the fair scheduler, over its run time. Under the
+	// MLFQ scheduler it goes on unless its level or a higher one holds another thread. The other
+	// policies let the other Ready threads go first. An EDF thread goes on unless another one has an
+	// earlier deadline.
+	bool requeue = prev->state == Running;
+	bool compete = c->sched->compete || prev->edf_runtime;
+	if (requeue && compete) {
+		make_ready(prev);
+		prev->metrics.ready_start_time = switch_time;
+	}
+	p = take_next(c, &switch_time); // choose next thread to run based on current scheduler type
 
-	// Update current thread state - only if it's not Blocked
-	// Blocked threads should stay blocked until semaphore releases them
-	if (gt_current->state != Unused && gt_current->state != Blocked) {
-		gt_current->state = Ready;
-		gettimeofday(&gt_current->metrics.ready_start_time, NULL);
+	if (p == prev || (!p && requeue)) {
+		prev->state = Running; // go on with the current thread
+		prev->metrics.exec_start_time = switch_time;
+		gt_reset_sig(SIGALRM);
+		return false;
 	}
-	
-	// Update new thread state
-	p->state = Running;
-	gettimeofday(&p->metrics.exec_start_time, NULL);
-	
-	// Prepare for context switch
-	old = &gt_current->ctx; // prepare pointers to context of current (will become old)
-	new = &p->ctx; // and new to new thread found in previous loop
-	gt_current = p; // switch current indicator to new thread
-	gt_switch(old, new); // perform context switch (assembly in gtswtch.S)
+	if (requeue && !compete) {
+		make_ready(prev);
+		prev->metrics.ready_start_time = switch_time;
+	}
+	if (!p) {
+		p = &c->idle; // blocked or exited, wait for work in the idle context
+	} else {
+		// Update wait time for the thread that's about to run
+		sched_attach(c, p);
+		update_ready_thread_metrics(p, &switch_time);
+		p->state = Running;
+		gettimeofday(&p->metrics.exec_start_time, NULL);
+	}
+
+	switch_to(c, prev, p, unlock);
+	finish_switch(); // resumed, possibly on another carrier
+	gt_reset_sig(SIGALRM); // reset signal, starting a new time slice
 	return true;
 }
 
+// yield: switch to another thread, false if the current thread goes on running
+bool gt_schedule(void) {
+	return schedule(NULL);
+}
+
 // return function for terminating thread
 void gt_stop(void) {
 	gt_return(0);
 }
 
-// create new thread by providing pointer to function that will act like "run" method
-int gt_create(void (*f)(void), struct thread_data *data) {
-	char *stack;
+// first function of every new thread, entered from gt_switch() with preemption still disabled
+static void gt_thread_start(void) {
+	finish_switch();
+	gt_reset_sig(SIGALRM);
+	gt_current->entry();
+}
+
+// create a thread, an EDF thread if edf is given (with deadline_us filled in)
+static int create_thread(void (*f)(void), struct thread_data *data, const struct gt_edf_attr *edf) {
+	char *stack, *top;
 	struct gt *p;
+	struct gt_carrier *home = NULL;
+	unsigned long bandwidth = 0;
 
 	// Validate priority
 	int priority = data->priority;
 	if (priority < MIN_PRIORITY) priority = MIN_PRIORITY;
 	if (priority > MAX_PRIORITY) priority = MAX_PRIORITY;
 
-	for (p = &gt_table[0];; p++) // find an empty slot
-		if (p == &gt_table[MAX_G_THREADS])
-			// if we have reached the end, gt_table is full and we cannot create a new thread
+	sigset_t saved;
+	preempt_disable(&saved);
+	if (edf) {
+		bandwidth = (edf->runtime_us * 1000000 + edf->deadline_us - 1) / edf->deadline_us;
+		home = edf_reserve(bandwidth);
+		if (!home) {
+			preempt_restore(&saved);
+			errno = EBUSY;
 			return -1;
-		else if (p->state == Unused)
-			break; // new slot was found
+		}
+	}
+	spin_lock(&gt_alloc_lock);
+	p = alloc_thread(); // take an Unused thread, growing the thread table if needed
+	if (!p) {
+		spin_unlock(&gt_alloc_lock);
+		if (home) {
+			edf_unreserve(home, bandwidth);
+		}
+		preempt_restore(&saved);
+		return -1;
+	}
 
-	stack = malloc(STACK_SIZE); // allocate memory for stack of newly created thread
-	if (!stack)
+	size_t stack_size = stack_class_size(data->stack_size ? data->stack_size : STACK_SIZE);
+	stack = stack_alloc(stack_size); // map or reuse a stack for the newly created thread
+	if (!stack) {
+		free_thread(p);
+		spin_unlock(&gt_alloc_lock);
+		if (home) {
+			edf_unreserve(home, bandwidth);
+		}
+		preempt_restore(&saved);
 		return -1;
+	}
+	spin_unlock(&gt_alloc_lock);
+	p->stack = stack;
+	p->stack_size = stack_size;
+	top = stack + STACK_GUARD_SIZE + stack_size;
 
-	*(uint64_t *) &stack[STACK_SIZE - 8] = (uint64_t) gt_stop;
+	*(uint64_t *) (top - 8) = (uint64_t) gt_stop;
 	//  put into the stack returning function gt_stop in case function calls return
-	*(uint64_t *) &stack[STACK_SIZE - 16] = (uint64_t) f; //  put provided function as a main "run" function
-	p->ctx.rsp = (uint64_t) &stack[STACK_SIZE - 16]; //  set stack pointer
-	p->state = Ready; //  set state
+	*(uint64_t *) (top - 16) = (uint64_t) gt_thread_start; //  started on the first switch to the thread
+	p->ctx.rsp = (uint64_t) (top - 16); //  set stack pointer
+	p->entry = f; //  provided function as a main "run" function
+	p->data = data; //  kept for gt_self_data(), must stay valid while the thread runs
 	p->priority = priority;              // Set the thread priority
 	p->original_priority = priority;     // Remember the original priority
-	p->starvation_count = 0;             // Initialize starvation counter
 	
 	// Set lottery tickets from thread_data 
 	p->tickets = data->tickets > 0 ? data->tickets : 1; // Ensure at least 1 ticket
+	p->sched = NULL; // put under the carrier's policy when it is queued
 	
 	// Initialize metrics for the new thread
 	init_thread_metrics(&p->metrics);
 	gettimeofday(&p->metrics.ready_start_time, NULL);
+
+	// An EDF thread releases its first job right away, on the carrier that admitted it
+	p->edf_runtime = 0;
+	if (edf) {
+		p->carrier = home;
+		p->edf_runtime = edf->runtime_us;
+		p->edf_period = edf->period_us;
+		p->edf_deadline = edf->deadline_us;
+		p->edf_bandwidth = bandwidth;
+		p->edf_sched_deadline = timeval_us(&p->metrics.ready_start_time) + edf->deadline_us;
+		p->edf_job_deadline = p->edf_sched_deadline;
+		p->edf_budget = (long) edf->runtime_us;
+	}
+	__atomic_add_fetch(&gt_live_threads, 1, __ATOMIC_RELAXED);
+	make_ready(p); //  set state and queue the thread on this carrier, an EDF thread on its own
+	preempt_restore(&saved);
 	
-	return 0;
+	return (int) p->id;
+}
+
+// create new thread by providing pointer to function that will act like "run" method
+int gt_create(void (*f)(void), struct thread_data *data) {
+	return create_thread(f, data, NULL);
+}
+
+// create an EDF thread, it runs before the threads of the scheduling policy. It is admitted to the
+// first carrier, starting with the calling one, with enough unreserved bandwidth, and stays there.
+int gt_create_edf(void (*f)(void), struct thread_data *data, const struct gt_edf_attr *attr) {
+	struct gt_edf_attr edf = *attr;
+	if (!edf.deadline_us) {
+		edf.deadline_us = edf.period_us;
+	}
+	if (edf.runtime_us == 0 || edf.runtime_us > edf.deadline_us || edf.deadline_us > edf.period_us) {
+		errno = EINVAL;
+		return -1;
+	}
+	return create_thread(f, data, &edf);
+}
+
+// End the current job of an EDF thread and wait for the next period, which releases the next job
+// with a full runtime. A job ending after its deadline counts as a miss; a thread late by more than a
+// period releases its next job right away instead of catching up. Other threads just yield.
+void gt_edf_wait(void) {
+	preempt_disable(NULL); // schedule() enables it again
+	struct gt_carrier *c = this_carrier();
+	struct gt *p = c->current;
+	if (p->edf_runtime) {
+		unsigned long now = now_us();
+		p->metrics.edf_jobs++;
+		if (now > p->edf_job_deadline) {
+			p->metrics.edf_deadline_misses++;
+		}
+		unsigned long release = p->edf_job_deadline - p->edf_deadline + p->edf_period;
+		p->edf_release = release > now ? release : now;
+		p->edf_job_deadline = p->edf_release + p->edf_deadline;
+		p->state = Throttled;
+		rb_insert(&c->edf_throttled, &p->rb_node, edf_release_before);
+	}
+	schedule(NULL);
+}
+
+// thread data the current thread was created with
+struct thread_data *gt_self_data(void) {
+	return gt_current->data;
+}
+
+// metrics the scheduler keeps for the current thread
+const struct gt_metrics *gt_self_metrics(void) {
+	return &gt_current->metrics;
 }
 
 // resets SIGALRM signal
 void gt_reset_sig(int sig) {
 	if (sig == SIGALRM) {
-		alarm(0); // Clear pending alarms if any
+		// Restart the time slice on this carrier's timer. The policy may size it per thread, an EDF
+		// thread runs until its runtime is used up. Any thread is preempted when the period of a
+		// Throttled EDF thread starts.
+		struct gt_carrier *c = this_carrier();
+		struct gt *p = c->current;
+		long slice_us = p->edf_runtime ? p->edf_budget :
+		                c->sched->slice_us ? c->sched->slice_us(c) : TIME_SLICE_US;
+		slice_us = edf_next_release_us(c, slice_us);
+		if (slice_us < 1) {
+			slice_us = 1; // a zero interval would disarm the timer
+		}
+		struct timespec interval = {slice_us / 1000000, slice_us % 1000000 * 1000};
+		struct itimerspec slice = {interval, interval};
+		timer_settime(c->timer, 0, &slice, NULL);
 	}
 
 	sigset_t set; // Create signal set
 	sigemptyset(&set); // Clear set
 	sigaddset(&set, sig); // Set signal (we use SIGALRM)
-	sigprocmask(SIG_UNBLOCK, &set, NULL); // Fetch and change the signal mask
-
-	if (sig == SIGALRM) {
-		ualarm(500, 500); // Schedule signal after given number of microseconds
-	}
+	pthread_sigmask(SIG_UNBLOCK, &set, NULL); // Fetch and change the signal mask
 }
 
 // uninterruptible sleep
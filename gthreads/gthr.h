@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,17 +9,35 @@
 #include <errno.h>
 #include <time.h>
 #include <sys/time.h>
+#include <sys/mman.h>
 #include <limits.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
 #include <bits/sigaction.h>
 #include <bits/types/sigset_t.h>
 
 enum {
-	MAX_G_THREADS = 5, // Maximum number of threads, used as array size for gttbl
-	STACK_SIZE = 0x400000, // Size of stack of each thread
+	GT_CHUNK_SIZE = 1024, // Threads allocated at once when the thread table grows
+	STACK_SIZE = 0x400000, // Default stack size of a thread
+	STACK_MIN_SIZE = 0x4000, // Smallest stack handed out, enough for a signal frame and some calls
+	STACK_GUARD_SIZE = 0x1000, // PROT_NONE page below each stack, an overflow faults instead of corrupting memory
+	STACK_POOL_MAX = 256, // Stacks of exited threads kept for reuse, further stacks are unmapped
+	IDLE_STACK_SIZE = 0x10000, // Stack of the idle context of the initial carrier
+	GT_DEQUE_SIZE = 256, // Ready threads a carrier can offer for stealing (power of two)
+	TIME_SLICE_US = 500, // Interval of the per-carrier preemption timer
 	MAX_PRIORITY = 10, // Maximum priority value (lowest priority)
 	MIN_PRIORITY = 0,  // Minimum priority value (highest priority)
 	MAX_TICKETS = 100, // Maximum number of tickets per thread for lottery scheduling
-	MAX_BLOCKED_THREADS = MAX_G_THREADS, // Maximum number of threads that can be blocked on a semaphore
+	READY_SLOTS = 1 << 20, // Ready threads the lottery or stride heap of one carrier can hold
+	STRIDE1 = 1 << 20, // Pass advance of a thread holding one ticket under stride scheduling
+	FAIR_LATENCY_US = 6000, // Period in which the fair scheduler runs every Ready thread of a carrier once
+	FAIR_MIN_GRANULARITY_US = 750, // Shortest time slice of the fair scheduler, the period stretches beyond
+	FAIR_WAKEUP_GRANULARITY_US = 1000, // vruntime lead over the running thread a woken thread needs to preempt it
+	STARVATION_LIMIT = 10, // Scheduling rounds a Ready thread waits before it is forced to run
+	MLFQ_LEVELS = 4, // Default number of levels of the multi-level feedback queue
+	MLFQ_BOOST_US = 50000, // Default interval at which the MLFQ scheduler moves every thread back to the top level
+	EDF_BANDWIDTH_PPM = 950000, // Share of a carrier's time EDF threads may reserve (millionths), the rest stays with the other threads
 };
 
 // Thread data structure to pass parameters to threads
@@ -27,22 +46,36 @@ struct thread_data {
     int priority;
 	int tickets;
     const char* label;
+	size_t stack_size; // 0 = STACK_SIZE, rounded up to a power of two
+};
+
+// Real-time parameters of an earliest-deadline-first thread, see gt_create_edf(). Each period the
+// thread releases a job that may run for runtime_us and must end, through gt_edf_wait(), within
+// deadline_us of the start of the period. runtime_us <= deadline_us <= period_us.
+struct gt_edf_attr {
+	unsigned long runtime_us;
+	unsigned long period_us;
+	unsigned long deadline_us; // 0 = period_us
 };
 
 // Semaphore structure with FIFO queue
 typedef struct {
     int value;                          // Current value of the semaphore
+    int lock;                           // Spinlock of the carriers changing the semaphore, held by a blocking thread until it switched away
     int wait_count;                     // Number of threads waiting on this semaphore
-    struct gt *wait_queue[MAX_BLOCKED_THREADS]; // Queue of waiting threads (FIFO)
-    int head;                           // Head of the queue
-    int tail;                           // Tail of the queue
+    struct gt *wait_head;               // Queue of waiting threads (FIFO), linked through the threads
+    struct gt *wait_tail;               // Last waiting thread
 } gt_semaphore_t;
 
-// Available scheduling algorithms
+// Available scheduling algorithms, EDF threads (gt_create_edf) run before the threads of any of them
 enum gt_scheduler_type {
     GT_SCHED_RR,  // Round Robin scheduler
     GT_SCHED_PRI, // Priority scheduler
-    GT_SCHED_LS   // Lottery scheduler
+    GT_SCHED_LS,  // Lottery scheduler
+    GT_SCHED_STRIDE, // Stride scheduler, deterministic proportional share by tickets
+    GT_SCHED_FAIR, // Fair scheduler, CPU time weighted by priority as in Linux CFS
+    GT_SCHED_MLFQ, // Multi-level feedback queue, threads move between levels by how long they run
+    GT_SCHED_COUNT // number of scheduling algorithms
 };
 
 // Thread performance tracking structure
@@ -65,6 +98,27 @@ struct gt_metrics {
     unsigned long wait_time_sum;        // Sum for average calculation
     unsigned long wait_time_sq_sum;     // Sum of squares for variance
     unsigned int wait_periods;          // Number of wait periods
+
+    unsigned int edf_jobs;              // Jobs an EDF thread ended with gt_edf_wait()
+    unsigned int edf_deadline_misses;   // Jobs that ended after their deadline
+    unsigned int edf_throttles;         // Times the runtime of a period ran out before the job ended
+};
+
+struct gt_carrier;
+struct gt_sched_ops;
+
+// Node of a red-black tree, embedded in the threads it orders
+struct gt_rb_node {
+	struct gt_rb_node *left;
+	struct gt_rb_node *right;
+	struct gt_rb_node *parent;
+	bool red;
+};
+
+// Red-black tree of threads, the leftmost node is cached
+struct gt_rb_tree {
+	struct gt_rb_node *root;
+	struct gt_rb_node *leftmost;
 };
 
 struct gt {
@@ -85,33 +139,87 @@ struct gt {
 		Running,
 		Ready,
 		Blocked,  // New state for blocked threads
+		Throttled, // EDF thread waiting for its next period
 	} state;
 	
-	// Thread priority (0 = highest, 10 = lowest)
+	// Thread priority (0 = highest, 10 = lowest), selects the run queue of a Ready thread. Under the
+	// MLFQ scheduler it is the thread's current level, other policies start from original_priority.
 	int priority;
 	// Original priority assigned at creation time
 	int original_priority;
-	// Starvation counter - incremented when thread is not scheduled
-	int starvation_count;
+	// Scheduling round in which the thread became Ready, its starvation is counted from here
+	unsigned long ready_tick;
+	// Links in the run queue of its priority while Ready. run_next also links a Blocked thread into
+	// its semaphore's wait queue and an Unused thread into the free list or the zombie list
+	struct gt *run_next;
+	struct gt *run_prev;
+	// Carrier that runs the thread or holds it in its run queue
+	struct gt_carrier *carrier;
+	// Policy the thread's scheduling state was set up for, see sched_attach()
+	const struct gt_sched_ops *sched;
+	// Thread ID, the index in the thread table; the main thread is 0
+	unsigned id;
+	// Stack mapping (guard page included) and usable stack size, NULL for the main thread
+	char *stack;
+	size_t stack_size;
+	// Parameters the thread was created with, NULL for the main thread
+	struct thread_data *data;
+	// Function run by the thread, started by gt_thread_start()
+	void (*entry)(void);
 	// Performance tracking data
 	struct gt_metrics metrics;
     
     // Number of lottery tickets for the lottery scheduler
     int tickets;
+    // Slot in its carrier's lottery or stride heap while Ready under those schedulers
+    unsigned ready_slot;
+    // Stride scheduling: pass advanced by stride = STRIDE1 / tickets each time the thread is picked
+    unsigned long pass;
+    unsigned long stride;
+    // Fair scheduling: execution time weighted by priority (ns at the weight of priority 5) and the
+    // insertion order breaking ties
+    unsigned long vruntime;
+    unsigned long fair_seq;
+    // MLFQ: time used at the current level and the boost interval in which the level was last reset
+    unsigned long mlfq_used;
+    unsigned long mlfq_epoch;
+    // Node in its carrier's fair tree while Ready, or in an EDF tree while Ready or Throttled
+    struct gt_rb_node rb_node;
+
+    // Earliest deadline first, edf_runtime is 0 for the other threads. An EDF thread never leaves the
+    // carrier that admitted it, edf_bandwidth (millionths) of that carrier is reserved for it. Times
+    // in us: the relative deadline, the absolute deadline of the current job, the deadline the thread
+    // is scheduled by and the runtime left, and while Throttled the start of its next period.
+    unsigned long edf_runtime;
+    unsigned long edf_period;
+    unsigned long edf_deadline;
+    unsigned long edf_bandwidth;
+    unsigned long edf_job_deadline;
+    unsigned long edf_sched_deadline;
+    long edf_budget;
+    unsigned long edf_release;
 };
 
 
+void gt_set_carriers(unsigned count); // number of carrier kernel threads started by gt_init, 0 = one per online core
 void gt_init(void); // initialize gttbl
 void gt_return(int ret); // terminate thread
 void gt_switch(struct gt_context *old, struct gt_context *new); // declaration from gtswtch.S
 bool gt_schedule(void); // yield and switch to another thread
 void gt_stop(void); // terminate current thread
-int gt_create(void (*f)(void), struct thread_data *data); // create new thread with given thread data
+int gt_create(void (*f)(void), struct thread_data *data); // create new thread with given thread data, returns its ID
+int gt_create_edf(void (*f)(void), struct thread_data *data, const struct gt_edf_attr *attr); // create an EDF thread, -1 with errno EBUSY if its bandwidth fits on no carrier
+void gt_edf_wait(void); // end the current job of an EDF thread and wait for its next period
+struct thread_data *gt_self_data(void); // thread data of the current thread
+const struct gt_metrics *gt_self_metrics(void); // metrics of the current thread, EDF job counters included
 void gt_reset_sig(int sig); // resets signal
 void gt_alarm_handle(int sig); // periodically triggered by alarm
 int gt_uninterruptible_nanosleep(time_t sec, long nanosec); // uninterruptible sleep
 void gt_print_stats(int sig); // print thread statistics - takes signal parameter for compatibility
-void gt_set_scheduler(enum gt_scheduler_type sched_type); // set the scheduling algorithm
+void gt_set_scheduler(enum gt_scheduler_type sched_type); // set the scheduling algorithm, also while threads run
+void gt_set_random_seed(uint64_t seed); // seed of the lottery draws for reproducible runs, before gt_init
+void gt_set_mlfq(unsigned levels, const unsigned long *quantum_us, unsigned long boost_us); // configure the MLFQ scheduler, before gt_init
+void gt_set_stack_trim(bool trim); // give the pages of pooled stacks back to the kernel
 
 // Semaphore operations
 void gt_sem_init(gt_semaphore_t* sem, int initial_value); // initialize semaphore
@@ -1,5 +1,102 @@
 // gthread control structures
 
-struct gt gt_table[MAX_G_THREADS];                                                // statically allocated table for thread control
-struct gt *gt_current;                                                          // pointer to current thread
+struct gt **gt_chunks;                                                          // thread table, chunks of GT_CHUNK_SIZE threads that never move
+unsigned gt_chunk_count;                                                        // number of allocated chunks
+unsigned gt_thread_count;                                                       // thread IDs handed out so far
+struct gt *gt_free_threads;                                                     // Unused threads for reuse, linked through run_next
+int gt_alloc_lock;                                                              // spinlock of the thread table and the stack pool
+int gt_edf_lock;                                                                // spinlock of the EDF bandwidth reserved on the carriers
 enum gt_scheduler_type gt_current_scheduler = GT_SCHED_PRI;                     // current scheduler type, default is priority-based
+unsigned gt_mlfq_levels = MLFQ_LEVELS;                                          // levels of the MLFQ scheduler, run queues 0 to gt_mlfq_levels - 1
+unsigned long gt_mlfq_quantum_us[MAX_PRIORITY + 1];                             // time a thread may use at each level, 0 = TIME_SLICE_US << level
+unsigned long gt_mlfq_boost_us = MLFQ_BOOST_US;                                 // interval of the MLFQ priority boost
+
+// Ready threads are kept in one FIFO run queue per priority, a set bit in ready_bitmap marks a
+// non-empty queue. Aging is applied when a queue's head is considered for selection.
+struct gt_run_queue {
+	struct gt *head;
+	struct gt *tail;
+};
+
+// Scheduling policy. The core keeps the Ready threads of a carrier in the run queues of their
+// priority, which is all some policies need; others keep them in a structure of their own as well,
+// maintained by enqueue and dequeue. Hooks left NULL do nothing. A policy runs on a carrier with
+// preemption disabled and only touches that carrier's structures.
+struct gt_sched_ops {
+	const char *name;
+	bool compete;                                                               // a preempted or yielding thread is queued before the pick, otherwise after it
+	bool aging;                                                                 // Ready threads gain priority while they wait, see effective_priority()
+	void (*attach)(struct gt *p);                                               // p comes under the policy, created or moved from another one
+	void (*enqueue)(struct gt_carrier *c, struct gt *p);                        // p joins c's Ready threads, before the run queue of its priority
+	void (*dequeue)(struct gt_carrier *c, struct gt *p);                        // p leaves c's Ready threads
+	struct gt *(*pick_next)(struct gt_carrier *c);                              // Ready thread of c to run next, still queued
+	void (*tick)(struct gt_carrier *c, struct gt *p, unsigned long exec_us,     // a run period of p on c ended
+	             const struct timeval *now);
+	void (*on_block)(struct gt_carrier *c, struct gt *p);                       // p blocked on a semaphore, after the tick of its last run
+	bool (*on_wake)(struct gt_carrier *c, struct gt *p);                        // p was woken and queued on c, true = preempt c's current thread
+	long (*slice_us)(struct gt_carrier *c);                                     // time slice of c's current thread, NULL = TIME_SLICE_US
+};
+
+// Chase-Lev work-stealing deque. The owning carrier pushes and pops at the bottom, other carriers
+// steal from the top. Bounded: a carrier simply keeps its threads once the deque is full.
+struct gt_deque {
+	long top __attribute__((aligned(64)));
+	long bottom __attribute__((aligned(64)));
+	struct gt *slots[GT_DEQUE_SIZE];
+};
+
+// A carrier is a kernel thread running green threads. Its run queues are only touched by itself
+// with preemption disabled; other carriers reach its threads through the deque alone.
+struct gt_carrier {
+	unsigned index;                                                             // position in gt_carriers, 0 runs main()
+	const struct gt_sched_ops *sched;                                           // policy the Ready threads are queued by, follows gt_current_scheduler
+	struct gt *current;                                                         // thread running on this carrier
+	struct gt idle;                                                             // context looking for work when no thread can run
+	struct gt *prev;                                                            // thread switched away from, handled by finish_switch()
+	int *unlock;                                                                // spinlock released once prev's context is saved
+	struct gt_run_queue run_queues[MAX_PRIORITY + 1];
+	uint32_t ready_bitmap;                                                      // bit n set = run_queues[n] not empty
+	unsigned nr_ready;                                                          // threads in run_queues
+	unsigned long sched_ticks;                                                  // number of scheduling rounds so far
+	// Lottery: tickets of the Ready threads in a Fenwick tree over densely used slots.
+	// Stride: the same slots hold a min-heap of the Ready threads ordered by pass.
+	struct gt **ready_slots;                                                    // slot -> thread
+	long *lottery_tree;                                                         // 1-based Fenwick tree of the tickets per slot
+	unsigned slot_count;                                                        // slots in use
+	unsigned long stride_pass;                                                  // pass of the thread picked last, threads joining start here
+	// Fair: the Ready threads in a red-black tree ordered by vruntime, leftmost runs next
+	struct gt_rb_tree fair_tree;
+	unsigned long fair_weight;                                                  // sum of the weights of the threads in the tree
+	unsigned long min_vruntime;                                                 // vruntime of the thread picked last, never decreases
+	unsigned long fair_seq;                                                     // next insertion number
+	unsigned long mlfq_epoch;                                                   // MLFQ boost interval of the last boost, in boost intervals since the epoch
+	unsigned lottery_capacity;                                                  // slots covered by the tree, a power of two
+	// EDF: the Ready EDF threads ordered by deadline, they run before all others, and the Throttled
+	// ones ordered by the start of their next period
+	struct gt_rb_tree edf_ready;
+	struct gt_rb_tree edf_throttled;
+	struct gt *edf_inbox;                                                       // EDF threads other carriers made Ready, linked through run_next
+	int edf_inbox_lock;
+	unsigned long edf_bandwidth;                                                // reserved by the EDF threads of this carrier, millionths
+	uint64_t random_state[4];                                                   // xoshiro256** generator of the lottery draws
+	timer_t timer;                                                              // preemption timer signalling this carrier only
+	pthread_t thread;
+	struct gt_deque deque;                                                      // surplus Ready threads offered to other carriers
+};
+
+struct gt_carrier *gt_carriers;
+unsigned gt_carrier_count;                                                      // requested by gt_set_carriers(), 0 = one per online core
+unsigned gt_idle_carriers;                                                      // carriers polling for work in carrier_idle()
+unsigned gt_live_threads;                                                       // created threads that did not exit, main included
+unsigned gt_blocked_threads;                                                    // threads waiting on a semaphore
+uint64_t gt_random_seed;                                                        // set by gt_set_random_seed()
+bool gt_random_seeded;                                                          // false = seed from the clock
+__thread struct gt_carrier *gt_this_carrier;                                    // carrier of the calling kernel thread, see this_carrier()
+
+// Stacks of exited threads, one list per power-of-two size class. A pooled stack is linked through
+// its lowest usable page, which stays resident when gt_stack_trim releases the rest of it.
+struct gt_free_stack {
+	struct gt_free_stack *next;
+} *gt_stack_pool[sizeof(size_t) * CHAR_BIT];
+unsigned gt_stack_pool_count;                                                   // stacks in all pool lists
+bool gt_stack_trim;                                                             // madvise(MADV_DONTNEED) stacks entering the pool
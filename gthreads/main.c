@@ -12,21 +12,12 @@
 
 #include "gthr.h"
 
-// Use extern declaration - the actual definition is in gthr_params.c for better organization
-extern struct thread_data thread_params[MAX_G_THREADS];
+// Parameters of the demo threads, each thread finds its own through gt_self_data()
+struct thread_data thread_params[4];
 
 // Thread function that works for any priority level
 void worker_thread(void) {
-    // Each thread knows its index based on creation order
-    static int thread_index = 0;
-    int my_index = thread_index++;
-    
-    if (my_index >= MAX_G_THREADS) {
-        printf("ERROR: Thread index out of bounds!\n");
-        return;
-    }
-    
-    struct thread_data *data = &thread_params[my_index];
+    struct thread_data *data = gt_self_data();
     
     int i = 0;
     
@@ -56,8 +47,17 @@ int main(int argc, char *argv[]) {
         } else if (strcmp(argv[1], "-l") == 0 || strcmp(argv[1], "--lottery") == 0) {
             gt_set_scheduler(GT_SCHED_LS);
             printf("Using Lottery Scheduling\n");
+        } else if (strcmp(argv[1], "-s") == 0 || strcmp(argv[1], "--stride") == 0) {
+            gt_set_scheduler(GT_SCHED_STRIDE);
+            printf("Using Stride Scheduling\n");
+        } else if (strcmp(argv[1], "-f") == 0 || strcmp(argv[1], "--fair") == 0) {
+            gt_set_scheduler(GT_SCHED_FAIR);
+            printf("Using Fair Scheduling\n");
+        } else if (strcmp(argv[1], "-m") == 0 || strcmp(argv[1], "--mlfq") == 0) {
+            gt_set_scheduler(GT_SCHED_MLFQ);
+            printf("Using Multi-level Feedback Queue\n");
         } else {
-            printf("Invalid argument. Use -r for Round Robin, -p for Priority, or -l for Lottery.\n");
+            printf("Invalid argument. Use -r for Round Robin, -p for Priority, -l for Lottery, -s for Stride, -f for Fair, or -m for MLFQ.\n");
             return 1;
         }
     } else {
@@ -0,0 +1,188 @@
+// Scheduler benchmark: cost of a yield (gt_schedule) as the number of Ready threads grows.
+// All threads yield in a loop; after every measured batch of yields more threads are created.
+// With -e a periodic EDF thread runs next to them, its job counters are reported per step and the
+// scheduling policy changes after every step. -L sets the number of MLFQ levels.
+//
+//   ./sched_bench [-r|-p|-l|-s|-f|-m] [-e] [-L levels] [-c carriers] [-S seed] [-n max threads] [yields per step]
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+
+#include "gthr.h"
+
+static long yields_per_step = 200000;
+static long yields = 0;
+static int max_threads = 16384;
+static int thread_count = 0;
+static double step_start_ns;
+static struct thread_data *bench_params;
+static enum gt_scheduler_type scheduler = GT_SCHED_PRI;
+
+static const char *const scheduler_names[GT_SCHED_COUNT] = {
+    [GT_SCHED_RR] = "Round Robin",
+    [GT_SCHED_PRI] = "Priority-based",
+    [GT_SCHED_LS] = "Lottery Scheduling",
+    [GT_SCHED_STRIDE] = "Stride Scheduling",
+    [GT_SCHED_FAIR] = "Fair Scheduling",
+    [GT_SCHED_MLFQ] = "Multi-level Feedback Queue",
+};
+
+// -e mode: one EDF thread with EDF_RUNTIME_US every EDF_PERIOD_US. Its jobs take EDF_WORK_US, every
+// tenth one EDF_OVERRUN_US on purpose: that job is throttled and misses its deadline.
+enum {
+    EDF_RUNTIME_US = 1000,
+    EDF_PERIOD_US = 10000,
+    EDF_WORK_US = 300,
+    EDF_OVERRUN_US = 1500,
+};
+static bool edf_mode = false;
+static struct thread_data edf_params = {.id = 1, .label = "EDF"};
+static struct thread_data greedy_params = {.id = 2, .label = "EDF"};
+static unsigned long edf_jobs, edf_misses, edf_throttles; // published by the EDF thread after each job
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void bench_thread(void);
+
+// Periodic EDF thread, only the first one publishes its counters
+void edf_thread(void) {
+    bool publish = gt_self_data() == &edf_params;
+    for (unsigned long job = 1; ; job++) {
+        double end = now_ns() + (job % 10 == 0 ? EDF_OVERRUN_US : EDF_WORK_US) * 1000.0;
+        while (now_ns() < end) {
+        }
+        gt_edf_wait();
+        if (publish) {
+            const struct gt_metrics *m = gt_self_metrics();
+            __atomic_store_n(&edf_jobs, m->edf_jobs, __ATOMIC_RELAXED);
+            __atomic_store_n(&edf_misses, m->edf_deadline_misses, __ATOMIC_RELAXED);
+            __atomic_store_n(&edf_throttles, m->edf_throttles, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// Create benchmark threads until `target` of them exist
+static void add_threads(int target) {
+    for (; thread_count < target; thread_count++) {
+        struct thread_data *data = &bench_params[thread_count];
+        data->id = thread_count + 1;
+        data->priority = thread_count % (MAX_PRIORITY + 1); // spread over all priority levels
+        data->tickets = 1 + thread_count % MAX_TICKETS;
+        data->label = "BENCH";
+        if (gt_create(bench_thread, data) < 0) {
+            fprintf(stderr, "Failed to create thread %d\n", thread_count + 1);
+            exit(1);
+        }
+    }
+}
+
+// Report the finished step and grow the thread population for the next one
+static void finish_step(void) {
+    double elapsed = now_ns() - step_start_ns;
+    if (edf_mode) {
+        printf("%8d | %12ld | %14.0f | %-26s | %8lu | %8lu | %9lu\n", thread_count, yields_per_step,
+               elapsed / yields_per_step, scheduler_names[scheduler], __atomic_load_n(&edf_jobs, __ATOMIC_RELAXED),
+               __atomic_load_n(&edf_misses, __ATOMIC_RELAXED), __atomic_load_n(&edf_throttles, __ATOMIC_RELAXED));
+    } else {
+        printf("%8d | %12ld | %14.0f\n", thread_count, yields_per_step, elapsed / yields_per_step);
+    }
+    fflush(stdout);
+    if (thread_count * 4 > max_threads) {
+        exit(0);
+    }
+
+    // Without the timer the new threads are created in one go instead of one time slice per round.
+    // The next step starts before the timer is unblocked: the pending tick may preempt this thread,
+    // and a fair scheduler lets it wait long for the creation burst it is charged with.
+    sigset_t alarm_set;
+    sigemptyset(&alarm_set);
+    sigaddset(&alarm_set, SIGALRM);
+    sigprocmask(SIG_BLOCK, &alarm_set, NULL);
+    if (edf_mode) {
+        scheduler = (scheduler + 1) % GT_SCHED_COUNT; // the carriers move their Ready threads over
+        gt_set_scheduler(scheduler);
+    }
+    add_threads(thread_count * 4);
+    yields = 0;
+    step_start_ns = now_ns();
+    sigprocmask(SIG_UNBLOCK, &alarm_set, NULL);
+}
+
+// Yield forever, every yield is one pass through the scheduler
+void bench_thread(void) {
+    while (true) {
+        if (__atomic_add_fetch(&yields, 1, __ATOMIC_RELAXED) == yields_per_step) {
+            finish_step();
+        }
+        gt_schedule();
+    }
+}
+
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0) {
+            scheduler = GT_SCHED_RR;
+        } else if (strcmp(argv[i], "-p") == 0) {
+            scheduler = GT_SCHED_PRI;
+        } else if (strcmp(argv[i], "-l") == 0) {
+            scheduler = GT_SCHED_LS;
+        } else if (strcmp(argv[i], "-s") == 0) {
+            scheduler = GT_SCHED_STRIDE;
+        } else if (strcmp(argv[i], "-f") == 0) {
+            scheduler = GT_SCHED_FAIR;
+        } else if (strcmp(argv[i], "-m") == 0) {
+            scheduler = GT_SCHED_MLFQ;
+        } else if (strcmp(argv[i], "-e") == 0) {
+            edf_mode = true;
+        } else if (strcmp(argv[i], "-L") == 0 && i + 1 < argc) {
+            gt_set_mlfq(atoi(argv[++i]), NULL, 0);
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            gt_set_carriers(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc) {
+            gt_set_random_seed(strtoull(argv[++i], NULL, 0));
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            max_threads = atoi(argv[++i]);
+        } else {
+            yields_per_step = atol(argv[i]);
+        }
+    }
+    bench_params = calloc(max_threads, sizeof(*bench_params));
+    if (!bench_params) {
+        perror("calloc");
+        return 1;
+    }
+
+    gt_set_scheduler(scheduler);
+    gt_init();
+    printf("%s scheduler, up to %d threads, %ld yields per step\n", scheduler_names[scheduler], max_threads,
+           yields_per_step);
+    if (edf_mode) {
+        struct gt_edf_attr attr = {.runtime_us = EDF_RUNTIME_US, .period_us = EDF_PERIOD_US};
+        if (gt_create_edf(edf_thread, &edf_params, &attr) < 0) {
+            perror("gt_create_edf");
+            return 1;
+        }
+        // Admission control: this one fits only on a carrier without the first EDF thread
+        struct gt_edf_attr greedy = {.runtime_us = 9 * EDF_PERIOD_US / 10, .period_us = EDF_PERIOD_US};
+        int greedy_id = gt_create_edf(edf_thread, &greedy_params, &greedy);
+        printf("EDF thread %d/%d us admitted, a %lu/%d us one %s\n", EDF_RUNTIME_US, EDF_PERIOD_US,
+               greedy.runtime_us, EDF_PERIOD_US, greedy_id >= 0 ? "too" : errno == EBUSY ? "rejected (EBUSY)" : "failed");
+        printf("%8s | %12s | %14s | %-26s | %8s | %8s | %9s\n", "Threads", "Yields", "ns per yield", "Scheduler",
+               "EDF jobs", "Misses", "Throttles");
+    } else {
+        printf("%8s | %12s | %14s\n", "Threads", "Yields", "ns per yield");
+    }
+
+    add_threads(4);
+    step_start_ns = now_ns();
+    gt_return(0); // the benchmark threads exit the process after the last step
+}
@@ -23,8 +23,8 @@ int shared_buffer[BUFFER_SIZE];  // Shared buffer array
 int buffer_in = 0;               // Index for next write
 int buffer_out = 0;              // Index for next read
 
-// Use extern declaration - the actual definition is in gthr_params.c
-extern struct thread_data thread_params[MAX_G_THREADS];
+// Parameters of the producer and consumer threads, each thread finds its own through gt_self_data()
+struct thread_data thread_params[4];
 
 // Function to print the current state of the buffer
 void print_buffer(int items) {
@@ -46,11 +46,7 @@ void print_buffer(int items) {
 
 // Producer thread function
 void producer_thread(void) {
-    // Each thread knows its index based on creation order
-    static int thread_index = 0;
-    int my_index = thread_index++;
-    
-    struct thread_data *data = &thread_params[my_index];
+    struct thread_data *data = gt_self_data();
     const char* priority_label = data->label;
     int id = data->id;
     
@@ -111,11 +107,7 @@ void producer_thread(void) {
 
 // Consumer thread function
 void consumer_thread(void) {
-    // Each thread knows its index based on creation order
-    static int thread_index = 0;
-    int my_index = thread_index++;
-    
-    struct thread_data *data = &thread_params[my_index];
+    struct thread_data *data = gt_self_data();
     const char* priority_label = data->label;
     int id = data->id;
     
@@ -185,8 +177,17 @@ int main(int argc, char *argv[]) {
         } else if (strcmp(argv[1], "-l") == 0 || strcmp(argv[1], "--lottery") == 0) {
             gt_set_scheduler(GT_SCHED_LS);
             printf("Using Lottery Scheduling\n");
+        } else if (strcmp(argv[1], "-s") == 0 || strcmp(argv[1], "--stride") == 0) {
+            gt_set_scheduler(GT_SCHED_STRIDE);
+            printf("Using Stride Scheduling\n");
+        } else if (strcmp(argv[1], "-f") == 0 || strcmp(argv[1], "--fair") == 0) {
+            gt_set_scheduler(GT_SCHED_FAIR);
+            printf("Using Fair Scheduling\n");
+        } else if (strcmp(argv[1], "-m") == 0 || strcmp(argv[1], "--mlfq") == 0) {
+            gt_set_scheduler(GT_SCHED_MLFQ);
+            printf("Using Multi-level Feedback Queue\n");
         } else {
-            printf("Invalid argument. Use -r for Round Robin, -p for Priority, or -l for Lottery.\n");
+            printf("Invalid argument. Use -r for Round Robin, -p for Priority, -l for Lottery, -s for Stride, -f for Fair, or -m for MLFQ.\n");
             return 1;
         }
     } else {
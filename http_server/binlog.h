@@ -0,0 +1,169 @@
+#ifndef BINLOG_H
+#define BINLOG_H
+
+// Binary log format shared by the server's logger process and the logdecode tool.
+//
+// A log file starts with a BinlogFileHeader followed by a stream of LogRecords, each directly
+// followed by detail_len bytes of text. Message texts are interned by the logger: the first use of
+// a message in a file is preceded by a BINLOG_STRING record defining its id, events then refer to
+// it by message_id. Timestamps are CLOCK_MONOTONIC, the header anchors them to wall-clock time.
+
+#include <arpa/inet.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <zlib.h>
+
+constexpr char BINLOG_MAGIC[8] = {'H', 'T', 'T', 'P', 'L', 'O', 'G', '1'};
+constexpr uint32_t BINLOG_VERSION = 1;
+
+enum BinlogRecordType : uint8_t {
+    BINLOG_EVENT = 1, // log event, detail holds the variable part of the message
+    BINLOG_STRING = 2, // defines message_id, detail holds the message text
+};
+
+struct BinlogFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    int64_t wall_clock_ns; // CLOCK_REALTIME when the file was opened
+    int64_t monotonic_ns; // CLOCK_MONOTONIC at the same instant
+};
+
+struct LogRecord {
+    int64_t timestamp_ns; // CLOCK_MONOTONIC
+    int32_t pid;
+    uint32_t client_addr; // IPv4 in network byte order, 0 without a client
+    uint32_t bytes; // response bytes for access records
+    uint32_t latency_us; // handshake start to response written for access records
+    uint16_t client_port;
+    uint16_t status; // HTTP status for access records, 0 otherwise
+    uint16_t message_id;
+    uint16_t detail_len;
+    int16_t worker; // -1 outside worker processes
+    uint8_t type;
+    uint8_t reserved[5];
+};
+
+static_assert(sizeof(BinlogFileHeader) == 32, "binary log header layout changed");
+static_assert(sizeof(LogRecord) == 40, "binary log record layout changed");
+
+// Render an event as a text log line, the same line the logger writes in text mode.
+// wall_offset_ns converts the monotonic timestamp to wall-clock time.
+inline int format_log_text(char *buf, const size_t size, const LogRecord &record, const char *message,
+                           const char *detail, const int64_t wall_offset_ns) {
+    const std::time_t seconds = (record.timestamp_ns + wall_offset_ns) / 1000000000LL;
+    std::tm local_time{};
+    localtime_r(&seconds, &local_time);
+    char timestamp[32];
+    std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &local_time);
+
+    size_t length = snprintf(buf, size, "[%s] [PID: %d]", timestamp, record.pid);
+    if (record.worker >= 0 && length < size) {
+        length += snprintf(buf + length, size - length, " [Worker: %d]", record.worker);
+    }
+    if (record.client_addr != 0 && length < size) {
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &record.client_addr, ip, sizeof(ip));
+        length += snprintf(buf + length, size - length, " [Client: %s:%d]", ip, record.client_port);
+    }
+    if (length < size) {
+        length += snprintf(buf + length, size - length, " %s%.*s", message, record.detail_len, detail);
+    }
+    if (record.status != 0 && length < size) {
+        length += snprintf(buf + length, size - length, " %u %u bytes %u us", record.status, record.bytes,
+                           record.latency_us);
+    }
+    return static_cast<int>(length < size ? length : size - 1);
+}
+
+// Sequential reader for binary logs, plain or gzip-compressed
+class BinlogReader {
+public:
+    explicit BinlogReader(const char *path) : in_(gzopen(path, "rb")) {
+    }
+
+    ~BinlogReader() {
+        if (in_) gzclose(in_);
+    }
+
+    BinlogReader(const BinlogReader &) = delete;
+    BinlogReader &operator=(const BinlogReader &) = delete;
+
+    bool is_open() const {
+        return in_ != nullptr;
+    }
+
+    // Next event with its message and detail, false at the end of the log or on a damaged log (see error())
+    bool next(LogRecord &record, std::string_view &message, std::string_view &detail) {
+        while (true) {
+            // Records and headers both start with 8 bytes, a header is recognised by its magic
+            if (!read_exact(&record, sizeof(BINLOG_MAGIC))) return false;
+
+            // Each logger start writes a fresh header with its own message table
+            if (memcmp(&record, BINLOG_MAGIC, sizeof(BINLOG_MAGIC)) == 0) {
+                BinlogFileHeader header{};
+                if (!read_exact(reinterpret_cast<char *>(&header) + sizeof(BINLOG_MAGIC),
+                                sizeof(header) - sizeof(BINLOG_MAGIC))) {
+                    error_ = "truncated header";
+                    return false;
+                }
+                if (header.version != BINLOG_VERSION || header.record_size != sizeof(LogRecord)) {
+                    error_ = "unsupported log version";
+                    return false;
+                }
+                wall_offset_ns_ = header.wall_clock_ns - header.monotonic_ns;
+                messages_.clear();
+                have_header_ = true;
+                continue;
+            }
+            if (!have_header_) {
+                error_ = "not a binary server log";
+                return false;
+            }
+            if (!read_exact(reinterpret_cast<char *>(&record) + sizeof(BINLOG_MAGIC),
+                            sizeof(record) - sizeof(BINLOG_MAGIC)) ||
+                !read_exact(detail_, record.detail_len)) {
+                error_ = "truncated record";
+                return false;
+            }
+
+            if (record.type == BINLOG_STRING) {
+                if (messages_.size() <= record.message_id) messages_.resize(record.message_id + 1);
+                messages_[record.message_id].assign(detail_, record.detail_len);
+                continue;
+            }
+            message = record.message_id < messages_.size() ? std::string_view(messages_[record.message_id])
+                                                           : std::string_view("<unknown message> ");
+            detail = std::string_view(detail_, record.detail_len);
+            return true;
+        }
+    }
+
+    // Offset converting the monotonic timestamps of the current segment to wall-clock time
+    int64_t wall_offset_ns() const {
+        return wall_offset_ns_;
+    }
+
+    const char *error() const {
+        return error_;
+    }
+
+private:
+    bool read_exact(void *buf, const unsigned size) {
+        return gzread(in_, buf, size) == static_cast<int>(size);
+    }
+
+    gzFile in_;
+    std::vector<std::string> messages_;
+    int64_t wall_offset_ns_ = 0;
+    bool have_header_ = false;
+    const char *error_ = nullptr;
+    char detail_[UINT16_MAX];
+};
+
+#endif
@@ -0,0 +1,303 @@
+// Replay the request stream recorded in the server's access log against a local server.
+//
+// Requests are taken from the access records of logs/log.bin (or a rotated .bin/.bin.gz segment) or
+// logs/log.txt, sent over TLS with their original inter-arrival times divided by the speed-up factor,
+// and the achieved throughput and latency are compared with the recorded ones.
+//
+//   ./replay [--speed X] [--concurrency N] [--host H] [--port P] [--limit N] [log]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "binlog.h"
+
+constexpr std::string_view ACCESS_MESSAGE = "Worker handled SSL client: ";
+
+struct ReplayRequest {
+    int64_t offset_ns; // arrival relative to the first recorded request
+    std::string method;
+    std::string path;
+    int status; // recorded status
+    uint32_t latency_us; // recorded server-side latency
+};
+
+struct ReplayResult {
+    int status;
+    int64_t latency_us;
+    int64_t lateness_us; // how much later than scheduled the request was sent
+};
+
+bool ends_with(const std::string &value, const std::string &suffix) {
+    return value.size() >= suffix.size() && value.compare(value.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Split "METHOD /path" of an access record, false for records without a request target
+bool parse_request_line(const std::string_view line, ReplayRequest &request) {
+    const size_t space = line.find(' ');
+    if (space == std::string_view::npos || space + 1 >= line.size()) return false;
+    request.method = line.substr(0, space);
+    request.path = line.substr(space + 1);
+    return true;
+}
+
+std::vector<ReplayRequest> load_binary_log(const std::string &path) {
+    std::vector<ReplayRequest> requests;
+    BinlogReader reader(path.c_str());
+    if (!reader.is_open()) {
+        std::cerr << "Failed to open " << path << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    LogRecord record{};
+    std::string_view message;
+    std::string_view detail;
+    while (reader.next(record, message, detail)) {
+        ReplayRequest request{};
+        if (record.status == 0 || message != ACCESS_MESSAGE || !parse_request_line(detail, request)) continue;
+        request.offset_ns = record.timestamp_ns + reader.wall_offset_ns();
+        request.status = record.status;
+        request.latency_us = record.latency_us;
+        requests.push_back(request);
+    }
+    if (reader.error()) {
+        std::cerr << path << ": " << reader.error() << ", replaying what was read" << std::endl;
+    }
+    return requests;
+}
+
+// Text lines only carry whole seconds, requests logged within the same second are spread evenly over it
+std::vector<ReplayRequest> load_text_log(const std::string &path) {
+    std::vector<ReplayRequest> requests;
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Failed to open " << path << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    std::vector<std::time_t> seconds;
+    std::string line;
+    while (std::getline(in, line)) {
+        const size_t access = line.find(ACCESS_MESSAGE);
+        if (line.size() < 21 || line[0] != '[' || access == std::string::npos) continue;
+
+        std::tm local_time{};
+        if (!strptime(line.c_str() + 1, "%Y-%m-%d %H:%M:%S", &local_time)) continue;
+        local_time.tm_isdst = -1;
+
+        // "<METHOD> <path> <status> <bytes> bytes <latency> us"
+        std::istringstream fields(line.substr(access + ACCESS_MESSAGE.size()));
+        ReplayRequest request{};
+        std::string bytes_unit;
+        std::string latency_unit;
+        uint32_t bytes = 0;
+        if (!(fields >> request.method >> request.path >> request.status >> bytes >> bytes_unit >>
+              request.latency_us >> latency_unit)) {
+            continue;
+        }
+        seconds.push_back(std::mktime(&local_time));
+        requests.push_back(request);
+    }
+
+    for (size_t first = 0; first < requests.size();) {
+        size_t last = first;
+        while (last < requests.size() && seconds[last] == seconds[first]) last++;
+        for (size_t i = first; i < last; i++) {
+            requests[i].offset_ns = seconds[i] * 1000000000LL + 1000000000LL * (i - first) / (last - first);
+        }
+        first = last;
+    }
+    return requests;
+}
+
+// Send one request over a fresh TLS connection and read the response until the server closes it
+ReplayResult send_request(SSL_CTX *ctx, const addrinfo *server, const ReplayRequest &request) {
+    ReplayResult result{0, 0, 0};
+    const auto start = std::chrono::steady_clock::now();
+
+    const int fd = socket(server->ai_family, server->ai_socktype, server->ai_protocol);
+    if (fd == -1) return result;
+    if (connect(fd, server->ai_addr, server->ai_addrlen) == -1) {
+        close(fd);
+        return result;
+    }
+
+    SSL *ssl = SSL_new(ctx);
+    SSL_set_fd(ssl, fd);
+    if (SSL_connect(ssl) == 1) {
+        const std::string message = request.method + " " + request.path +
+                                    " HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+        if (SSL_write(ssl, message.data(), static_cast<int>(message.size())) > 0) {
+            char buffer[16384];
+            std::string head;
+            int n;
+            while ((n = SSL_read(ssl, buffer, sizeof(buffer))) > 0) {
+                if (head.size() < 12) head.append(buffer, std::min<size_t>(n, 12));
+            }
+            if (head.size() >= 12) result.status = std::atoi(head.c_str() + 9);
+        }
+        SSL_shutdown(ssl);
+    }
+    SSL_free(ssl);
+    close(fd);
+
+    result.latency_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+int64_t percentile(std::vector<int64_t> values, const double fraction) {
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, static_cast<size_t>(fraction * values.size()))];
+}
+
+void print_row(const char *name, const int64_t recorded, const int64_t replayed) {
+    std::cout << std::left << std::setw(16) << name << std::right << std::setw(14) << recorded << std::setw(14)
+              << replayed << std::setw(14) << replayed - recorded << '\n';
+}
+
+int main(int argc, char *argv[]) {
+    double speed = 1.0;
+    int concurrency = 16;
+    std::string host = "localhost";
+    std::string port = "8080";
+    size_t limit = 0;
+    std::string path;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--speed" && i + 1 < argc) {
+            speed = std::atof(argv[++i]);
+        } else if (arg == "--concurrency" && i + 1 < argc) {
+            concurrency = std::atoi(argv[++i]);
+        } else if (arg == "--host" && i + 1 < argc) {
+            host = argv[++i];
+        } else if (arg == "--port" && i + 1 < argc) {
+            port = argv[++i];
+        } else if (arg == "--limit" && i + 1 < argc) {
+            limit = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg[0] == '-') {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--speed X] [--concurrency N] [--host H] [--port P] [--limit N] [log]" << std::endl;
+            return 1;
+        } else {
+            path = arg;
+        }
+    }
+    if (speed <= 0 || concurrency <= 0) {
+        std::cerr << "Speed and concurrency must be positive" << std::endl;
+        return 1;
+    }
+    if (path.empty()) {
+        struct stat file_stat{};
+        path = stat("logs/log.bin", &file_stat) == 0 ? "logs/log.bin" : "logs/log.txt";
+    }
+
+    std::vector<ReplayRequest> requests = ends_with(path, ".bin") || ends_with(path, ".bin.gz")
+                                              ? load_binary_log(path)
+                                              : load_text_log(path);
+    // Only idempotent requests are replayed, the log does not record request bodies
+    const size_t recorded_total = requests.size();
+    requests.erase(std::remove_if(requests.begin(), requests.end(), [](const ReplayRequest &request) {
+        return request.method != "GET" && request.method != "HEAD";
+    }), requests.end());
+    std::stable_sort(requests.begin(), requests.end(), [](const ReplayRequest &a, const ReplayRequest &b) {
+        return a.offset_ns < b.offset_ns;
+    });
+    if (limit > 0 && requests.size() > limit) requests.resize(limit);
+    if (requests.empty()) {
+        std::cerr << "No replayable requests in " << path << std::endl;
+        return 1;
+    }
+    const int64_t first_ns = requests.front().offset_ns;
+    for (auto &request: requests) request.offset_ns -= first_ns;
+
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *server = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &server) != 0) {
+        std::cerr << "Failed to resolve " << host << std::endl;
+        return 1;
+    }
+
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, nullptr); // the server uses a self-signed certificate
+
+    std::cout << "Replaying " << requests.size() << " of " << recorded_total << " requests from " << path << " at "
+              << speed << "x with " << concurrency << " connections" << std::endl;
+
+    // Requests are claimed in order, each client waits for its request's scheduled time
+    std::vector<ReplayResult> results(requests.size());
+    std::atomic<size_t> next_request{0};
+    const auto replay_start = std::chrono::steady_clock::now();
+    std::vector<std::thread> clients;
+    for (int i = 0; i < concurrency; i++) {
+        clients.emplace_back([&] {
+            size_t index;
+            while ((index = next_request++) < requests.size()) {
+                const auto scheduled = replay_start + std::chrono::nanoseconds(
+                                           static_cast<int64_t>(requests[index].offset_ns / speed));
+                std::this_thread::sleep_until(scheduled);
+                const int64_t lateness_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - scheduled).count();
+                results[index] = send_request(ctx, server, requests[index]);
+                results[index].lateness_us = lateness_us;
+            }
+        });
+    }
+    for (auto &client: clients) client.join();
+    const double replay_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - replay_start).count();
+    freeaddrinfo(server);
+    SSL_CTX_free(ctx);
+
+    std::vector<int64_t> recorded_latency;
+    std::vector<int64_t> replayed_latency;
+    std::vector<int64_t> lateness;
+    size_t failed = 0;
+    size_t status_changed = 0;
+    for (size_t i = 0; i < requests.size(); i++) {
+        recorded_latency.push_back(requests[i].latency_us);
+        lateness.push_back(results[i].lateness_us);
+        if (results[i].status == 0) {
+            failed++;
+            continue;
+        }
+        replayed_latency.push_back(results[i].latency_us);
+        status_changed += results[i].status != requests[i].status;
+    }
+
+    const double recorded_seconds = std::max(requests.back().offset_ns / 1e9 / speed, 1e-9);
+    std::cout << std::fixed << std::setprecision(1)
+              << "throughput      recorded " << requests.size() / recorded_seconds << " req/s (scaled to "
+              << speed << "x), replayed " << requests.size() / replay_seconds << " req/s\n"
+              << "failed          " << failed << "\n"
+              << "status changed  " << status_changed << "\n"
+              << "send lateness   p50 " << percentile(lateness, 0.5) << " us, p99 " << percentile(lateness, 0.99)
+              << " us\n\n";
+
+    // Recorded latency is measured by the server from handshake start to response written,
+    // replayed latency by this client from connect to the end of the response
+    std::cout << std::left << std::setw(16) << "latency (us)" << std::right << std::setw(14) << "recorded"
+              << std::setw(14) << "replayed" << std::setw(14) << "delta" << '\n';
+    print_row("p50", percentile(recorded_latency, 0.5), percentile(replayed_latency, 0.5));
+    print_row("p90", percentile(recorded_latency, 0.9), percentile(replayed_latency, 0.9));
+    print_row("p99", percentile(recorded_latency, 0.99), percentile(replayed_latency, 0.99));
+    print_row("max", percentile(recorded_latency, 1.0), percentile(replayed_latency, 1.0));
+    return failed == requests.size() ? 1 : 0;
+}
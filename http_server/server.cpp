@@ -7,6 +7,8 @@
 #include <unistd.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #include <sys/types.h>
@@ -17,220 +19,2068 @@
 #include <arpa/inet.h>
 #include <ctime>
 #include <csignal>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <sys/mman.h>
+#include <chrono>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <execinfo.h>
+#include <dlfcn.h>
+#include <cxxabi.h>
+#include <map>
+#include <array>
+#include <memory>
+#include <variant>
+#include <climits>
+#include <optional>
+#include <memory_resource>
+#include <string_view>
+#include <charconv>
+#include <fcntl.h>
+#include <zlib.h>
+#include "binlog.h"
+
+// Compile-time capacities, they size static arrays and tables in shared memory
+#define TLS_MAX_EARLY_DATA 1024 // early data limit, the size of a connection's early data buffer
+#define EARLY_DATA_REPLAY_SLOTS 4096 // shared anti-replay table entries (power of two)
+#define WORKER_THREAD_SLOTS 64 // per-worker threads tracked in the shared worker table
+#define TRACE_RING_SIZE 8192 // trace spans kept per worker (power of two), the oldest are overwritten first
+#define PROFILER_MAX_SAMPLES 16384 // preallocated samples per worker between two flushes
+#define PROFILER_MAX_DEPTH 48 // stack frames kept per sample
+
+#define DEFAULT_CONFIG_PATH "server.conf"
+
+// Runtime configuration, read from the configuration file at startup and again on SIGHUP.
+// server.conf documents every setting; the values here are the defaults for missing keys.
+struct ServerConfig {
+    int port = 8080;
+    int workers = 3;
+    int listen_backlog = 10;
+    std::string index_path = "www/index.html";
+    std::string file_not_found_path = "www/error_404.html";
+    std::string error_503_path = "www/error_503.html";
+    std::string status_path = "/server-status";
+    std::string upload_dir = "www/uploads";
+    size_t upload_block_size = 1024 * 1024;
+    bool upload_direct_io = false;
+    size_t request_buffer_size = 1024;
+    size_t php_buffer_size = 16384;
+    size_t header_block_limit = 16384;
+    size_t request_arena_size = 256 * 1024;
+    size_t request_arena_max_retained = 16 * 1024 * 1024;
+
+    int log_msg_queue_key = 1234;
+    bool log_binary = false;
+    size_t log_rotate_bytes = 64 * 1024 * 1024;
+    int log_rotate_seconds = 86400;
+    int log_retain_segments = 14;
+    bool log_compress = true;
+
+    int handshake_threads = 0;
+    int request_threads = 1;
+    int worker_backlog = 4;
+    int worker_heartbeat_ms = 1000;
+    int worker_stall_timeout_ms = 5000;
+    int request_deadline_ms = 30000;
+    bool cpu_affinity = false;
+    bool dispatch_by_incoming_cpu = true;
+
+    std::string tls_certificate = "certificates/server.crt";
+    std::string tls_private_key = "certificates/server.key";
+    std::string tls_min_version = "TLSv1.2";
+    std::string tls_cipher_list; // TLS 1.2 ciphers, empty for the OpenSSL default
+    std::string tls_ciphersuites; // TLS 1.3 suites, empty for the OpenSSL default
+    int tls_session_cache_size = 20480;
+    bool tls_early_data = false;
+    int tls_ticket_lifetime = 7200;
+    bool tls_dynamic_records = true;
+    int tls_record_small = 1369;
+    int tls_record_large = 16384;
+    int tls_record_boost_count = 40;
+    int tls_record_idle_ms = 1000;
+
+    int rate_limit_rps = 0;
+    int rate_limit_burst = 20;
+    int rate_limit_buckets = 8192;
+
+    bool profiler_enabled = false;
+    int profiler_hz = 99;
+    int profiler_flush_ms = 10000;
+
+    int proxy_pool_size = 8;
+    int proxy_timeout_ms = 10000;
+    int proxy_health_interval_ms = 2000;
+    std::vector<std::pair<std::string, std::string>> proxy_routes; // path prefix and "unix:/path" or "host:port"
+};
+
+struct ConfigOption {
+    const char *key;
+    std::variant<int ServerConfig::*, size_t ServerConfig::*, bool ServerConfig::*, std::string ServerConfig::*> field;
+    bool restart; // sizes processes, threads or shared tables: only applied at startup
+};
+
+const ConfigOption config_options[] = {
+    {"port", &ServerConfig::port, true},
+    {"workers", &ServerConfig::workers, true},
+    {"listen_backlog", &ServerConfig::listen_backlog, true},
+    {"index_path", &ServerConfig::index_path, false},
+    {"file_not_found_path", &ServerConfig::file_not_found_path, false},
+    {"error_503_path", &ServerConfig::error_503_path, false},
+    {"status_path", &ServerConfig::status_path, false},
+    {"upload_dir", &ServerConfig::upload_dir, true},
+    {"upload_block_size", &ServerConfig::upload_block_size, false},
+    {"upload_direct_io", &ServerConfig::upload_direct_io, false},
+    {"request_buffer_size", &ServerConfig::request_buffer_size, false},
+    {"php_buffer_size", &ServerConfig::php_buffer_size, false},
+    {"header_block_limit", &ServerConfig::header_block_limit, false},
+    {"request_arena_size", &ServerConfig::request_arena_size, true},
+    {"request_arena_max_retained", &ServerConfig::request_arena_max_retained, false},
+    {"log_msg_queue_key", &ServerConfig::log_msg_queue_key, true},
+    {"log_binary", &ServerConfig::log_binary, false},
+    {"log_rotate_bytes", &ServerConfig::log_rotate_bytes, false},
+    {"log_rotate_seconds", &ServerConfig::log_rotate_seconds, false},
+    {"log_retain_segments", &ServerConfig::log_retain_segments, false},
+    {"log_compress", &ServerConfig::log_compress, false},
+    {"handshake_threads", &ServerConfig::handshake_threads, true},
+    {"request_threads", &ServerConfig::request_threads, true},
+    {"worker_backlog", &ServerConfig::worker_backlog, false},
+    {"worker_heartbeat_ms", &ServerConfig::worker_heartbeat_ms, false},
+    {"worker_stall_timeout_ms", &ServerConfig::worker_stall_timeout_ms, false},
+    {"request_deadline_ms", &ServerConfig::request_deadline_ms, false},
+    {"cpu_affinity", &ServerConfig::cpu_affinity, true},
+    {"dispatch_by_incoming_cpu", &ServerConfig::dispatch_by_incoming_cpu, false},
+    {"tls_certificate", &ServerConfig::tls_certificate, true},
+    {"tls_private_key", &ServerConfig::tls_private_key, true},
+    {"tls_min_version", &ServerConfig::tls_min_version, true},
+    {"tls_cipher_list", &ServerConfig::tls_cipher_list, true},
+    {"tls_ciphersuites", &ServerConfig::tls_ciphersuites, true},
+    {"tls_session_cache_size", &ServerConfig::tls_session_cache_size, true},
+    {"tls_early_data", &ServerConfig::tls_early_data, true},
+    {"tls_ticket_lifetime", &ServerConfig::tls_ticket_lifetime, true},
+    {"tls_dynamic_records", &ServerConfig::tls_dynamic_records, false},
+    {"tls_record_small", &ServerConfig::tls_record_small, false},
+    {"tls_record_large", &ServerConfig::tls_record_large, false},
+    {"tls_record_boost_count", &ServerConfig::tls_record_boost_count, false},
+    {"tls_record_idle_ms", &ServerConfig::tls_record_idle_ms, false},
+    {"rate_limit_rps", &ServerConfig::rate_limit_rps, false},
+    {"rate_limit_burst", &ServerConfig::rate_limit_burst, false},
+    {"rate_limit_buckets", &ServerConfig::rate_limit_buckets, true},
+    {"profiler_enabled", &ServerConfig::profiler_enabled, true},
+    {"profiler_hz", &ServerConfig::profiler_hz, false},
+    {"profiler_flush_ms", &ServerConfig::profiler_flush_ms, false},
+    {"proxy_pool_size", &ServerConfig::proxy_pool_size, false},
+    {"proxy_timeout_ms", &ServerConfig::proxy_timeout_ms, false},
+    {"proxy_health_interval_ms", &ServerConfig::proxy_health_interval_ms, false},
+};
+
+std::string_view trim(std::string_view value) {
+    while (!value.empty() && isspace(static_cast<unsigned char>(value.front()))) value.remove_prefix(1);
+    while (!value.empty() && isspace(static_cast<unsigned char>(value.back()))) value.remove_suffix(1);
+    return value;
+}
+
+// Integer with an optional k, m or g suffix (powers of 1024)
+bool parse_config_number(const std::string_view value, int64_t &out) {
+    const auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), out);
+    if (ec != std::errc()) return false;
+    const std::string_view suffix = value.substr(end - value.data());
+    if (suffix.empty()) return true;
+    if (suffix.size() != 1) return false;
+    switch (tolower(static_cast<unsigned char>(suffix[0]))) {
+        case 'k': out *= 1024; return true;
+        case 'm': out *= 1024 * 1024; return true;
+        case 'g': out *= 1024 * 1024 * 1024LL; return true;
+        default: return false;
+    }
+}
+
+bool parse_config_value(const std::string_view value, int ServerConfig::*field, ServerConfig &config) {
+    int64_t number;
+    if (!parse_config_number(value, number) || number < INT_MIN || number > INT_MAX) return false;
+    config.*field = static_cast<int>(number);
+    return true;
+}
+
+bool parse_config_value(const std::string_view value, size_t ServerConfig::*field, ServerConfig &config) {
+    int64_t number;
+    if (!parse_config_number(value, number) || number < 0) return false;
+    config.*field = static_cast<size_t>(number);
+    return true;
+}
+
+bool parse_config_value(const std::string_view value, bool ServerConfig::*field, ServerConfig &config) {
+    if (value == "1" || value == "true" || value == "on" || value == "yes") {
+        config.*field = true;
+    } else if (value == "0" || value == "false" || value == "off" || value == "no") {
+        config.*field = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parse_config_value(std::string_view value, std::string ServerConfig::*field, ServerConfig &config) {
+    if (value.size() >= 2 && value.front() == '"' && value.back() == '"') value = value.substr(1, value.size() - 2);
+    config.*field = value;
+    return true;
+}
+
+// Settings whose combination would break the server
+const char *validate_config(const ServerConfig &config) {
+    if (config.port < 1 || config.port > 65535) return "port must be between 1 and 65535";
+    if (config.workers < 1) return "workers must be at least 1";
+    if (config.request_threads < 1) return "request_threads must be at least 1";
+    if (config.request_threads >= WORKER_THREAD_SLOTS) return "request_threads exceeds the worker thread slots";
+    if (config.request_buffer_size < 64 || config.php_buffer_size < 64) return "buffer sizes must be at least 64";
+    if (config.upload_block_size == 0 || config.upload_block_size % 4096 != 0) {
+        return "upload_block_size must be a positive multiple of 4096";
+    }
+    if (config.rate_limit_buckets <= 0 || (config.rate_limit_buckets & (config.rate_limit_buckets - 1)) != 0) {
+        return "rate_limit_buckets must be a power of two";
+    }
+    if (config.tls_record_small < 1 || config.tls_record_large < 1 || config.tls_record_small > 16384 ||
+        config.tls_record_large > 16384) {
+        return "TLS record sizes must be between 1 and 16384";
+    }
+    if (config.tls_min_version != "TLSv1.2" && config.tls_min_version != "TLSv1.3") {
+        return "tls_min_version must be TLSv1.2 or TLSv1.3";
+    }
+    if (config.worker_heartbeat_ms < 1 || config.profiler_hz < 1 || config.proxy_timeout_ms < 1 ||
+        config.proxy_health_interval_ms < 1) {
+        return "intervals, timeouts and rates must be positive";
+    }
+    if (config.worker_heartbeat_ms >= config.worker_stall_timeout_ms) {
+        return "worker_heartbeat_ms must be below worker_stall_timeout_ms";
+    }
+    return nullptr;
+}
+
+// Read a configuration file of "key = value" lines on top of the defaults, '#' starts a comment.
+// "proxy = <prefix> <upstream>" may be repeated, one line per route.
+bool parse_config(const std::string &path, ServerConfig &config, std::string &error) {
+    std::ifstream in(path);
+    if (!in) {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    std::string line;
+    for (int line_number = 1; std::getline(in, line); line_number++) {
+        const std::string_view content = trim(std::string_view(line).substr(0, line.find('#')));
+        if (content.empty()) continue;
+        const size_t equals = content.find('=');
+        const std::string_view key = trim(content.substr(0, equals));
+        const std::string_view value = equals == std::string_view::npos ? "" : trim(content.substr(equals + 1));
+        const std::string location = path + ":" + std::to_string(line_number) + ": ";
+        if (equals == std::string_view::npos) {
+            error = location + "expected key = value";
+            return false;
+        }
+
+        if (key == "proxy") {
+            std::istringstream route{std::string(value)};
+            std::string prefix, upstream;
+            if (!(route >> prefix >> upstream) || prefix.front() != '/') {
+                error = location + "expected proxy = <path prefix> <upstream>";
+                return false;
+            }
+            config.proxy_routes.emplace_back(prefix, upstream);
+            continue;
+        }
+
+        const auto option = std::find_if(std::begin(config_options), std::end(config_options),
+                                         [&](const ConfigOption &o) { return key == o.key; });
+        if (option == std::end(config_options)) {
+            error = location + "unknown setting " + std::string(key);
+            return false;
+        }
+        if (!std::visit([&](auto field) { return parse_config_value(value, field, config); }, option->field)) {
+            error = location + "invalid value for " + std::string(key);
+            return false;
+        }
+    }
+
+    if (const char *invalid = validate_config(config)) {
+        error = path + ": " + invalid;
+        return false;
+    }
+    return true;
+}
+
+// Current configuration snapshot. A reload publishes a new snapshot instead of changing the current
+// one, and earlier snapshots are never freed, so a thread may keep using a reference while a reload
+// happens. Reloads are rare and a snapshot is small.
+std::atomic<const ServerConfig *> current_config{new ServerConfig()};
+std::string config_path = DEFAULT_CONFIG_PATH;
 
-#define PORT 8080
-#define INDEX_PATH "www/index.html"
-#define FILE_NOT_FOUND_PATH "www/error_404.html"
-#define ERROR_503_PATH "www/error_503.html"
-#define MAX_WORKERS 3
-#define LOG_MSG_QUEUE_KEY 1234
-#define UPLOAD_DIR "www/uploads"
+const ServerConfig &config() {
+    return *current_config.load(std::memory_order_acquire);
+}
 
+// Log event as sent to the logger: the record followed by the message text, a NUL and the detail
 struct LogMessage {
     long mtype;
-    char message[512];
+    LogRecord record;
+    char text[512];
+};
+
+// Write path of a connection. Each SSL_write produces one record, so the first bytes of a response go out
+// in records that fit a single TCP segment and can be decrypted as soon as they arrive, while bulk data
+// uses full records to minimise framing and syscall overhead. The writer lives with its connection, so
+// every write on it counts towards the ramp: a 100 Continue, a streamed proxy response and the final
+// response alike. Output that pauses longer than tls_record_idle_ms, such as a proxied response waiting
+// for its upstream, restarts with small records because the congestion window has likely decayed.
+class TlsRecordWriter {
+public:
+    TlsRecordWriter() = default;
+    explicit TlsRecordWriter(SSL *ssl) : ssl_(ssl) {}
+
+    bool write(const char *data, size_t len);
+
+private:
+    bool write_record(const char *data, size_t len);
+
+    SSL *ssl_ = nullptr;
+    int small_records_ = 0;
+    std::chrono::steady_clock::time_point last_write_{};
 };
 
-std::string get_timestamp() {
-    const std::time_t now = std::time(nullptr);
-    char buf[100];
-    std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
-    return std::string(buf);
+// Accepted client connection, passed from the handshake stage to the request stage
+struct ClientConnection {
+    int fd;
+    SSL *ssl;
+    TlsRecordWriter writer; // all responses on ssl go through it
+    char ip[INET_ADDRSTRLEN];
+    int port;
+    char early_data[TLS_MAX_EARLY_DATA]; // request received as TLS 1.3 early data, if any
+    size_t early_data_len;
+    bool early_data_truncated; // early data did not fit, the request is answered with 425
+    bool early_response; // answered from early data before the handshake completes
+    uint32_t addr; // client IPv4 address in network byte order
+    int64_t accepted_ns; // handshake start, used for the request latency
+};
+
+// Server-wide counters in shared memory, updated by all workers and reported on status_path
+struct ServerMetrics {
+    std::atomic<uint64_t> early_data_accepted; // early requests served before the handshake round trip
+    std::atomic<uint64_t> early_data_rejected; // early requests answered with 425 Too Early
+    std::atomic<uint64_t> early_data_replayed; // early data refused because the ticket was already used
+    std::atomic<uint64_t> tls_records_small; // records written with tls_record_small payload limit
+    std::atomic<uint64_t> tls_records_large; // records written with tls_record_large payload limit
+    std::atomic<uint64_t> tls_record_idle_resets; // connections dropped back to small records after idling
+    std::atomic<uint64_t> rate_limited; // connections reset before reaching a worker
+    std::atomic<uint64_t> arena_requests; // requests handled with a request arena
+    std::atomic<uint64_t> arena_chunk_allocations; // arena chunks obtained with malloc, zero in the steady state
+    std::atomic<uint64_t> request_heap_allocations; // operator new calls and arena chunks while handling requests
+    std::atomic<uint64_t> requests_with_heap_allocations; // requests that made at least one such call
+    std::atomic<uint64_t> proxy_requests; // requests forwarded to a proxy upstream
+    std::atomic<uint64_t> proxy_errors; // proxied requests answered with 502
+    std::atomic<uint64_t> proxy_connections_opened; // upstream connections established
+    std::atomic<uint64_t> proxy_connections_reused; // requests sent over a pooled upstream connection
+};
+
+// Session fingerprints of tickets that already carried early data, shared by all workers so a
+// replayed ClientHello is refused even when it lands on a different worker process
+struct EarlyDataReplayCache {
+    std::atomic<uint64_t> fingerprint[EARLY_DATA_REPLAY_SLOTS];
+    std::atomic<int64_t> expires[EARLY_DATA_REPLAY_SLOTS];
+};
+
+// Per-client token bucket, locked by its spinlock so any process holding the table may update it
+struct RateBucket {
+    std::atomic_flag lock;
+    uint32_t client_addr; // IPv4 address in network order, 0 for a free entry
+    double tokens;
+    int64_t updated_ns;
+};
+
+// Worker state shared with the master, which uses it for liveness, hang detection and dispatch decisions
+struct WorkerSlot {
+    std::atomic<pid_t> pid; // 0 while the worker is not running
+    std::atomic<int64_t> respawn_ns; // retry time after the worker failed to start, 0 if none is pending
+    std::atomic<int64_t> heartbeat_ns; // last time the worker's dispatch loop was responsive
+    std::atomic<int> in_flight; // connections dispatched by the master and not yet finished
+    std::atomic<uint64_t> requests_served;
+    std::atomic<int64_t> busy_since_ns[WORKER_THREAD_SLOTS]; // start of each thread's current connection, 0 if idle
+};
+
+ServerMetrics *server_metrics = nullptr;
+EarlyDataReplayCache *replay_cache = nullptr;
+RateBucket *rate_buckets = nullptr;
+WorkerSlot *worker_slots = nullptr;
+
+int64_t monotonic_ns() {
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Completed span of a request phase. Names are string literals, so recording a span never allocates.
+struct TraceEvent {
+    const char *name;
+    int64_t start_ns;
+    int64_t duration_ns;
+    pid_t tid;
+};
+
+// Per-process ring of the most recent spans, dumped as Chrome trace-event JSON on SIGUSR1
+TraceEvent trace_ring[TRACE_RING_SIZE];
+std::atomic<uint64_t> trace_next{0};
+volatile sig_atomic_t trace_dump_requested = 0;
+
+void request_trace_dump(int) {
+    trace_dump_requested = 1;
+}
+
+// Records the lifetime of the object as a span in the trace ring: two clock reads and a few stores
+class TraceSpan {
+public:
+    explicit TraceSpan(const char *name) : name_(name), start_(monotonic_ns()) {}
+
+    ~TraceSpan() {
+        thread_local const pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+        TraceEvent &event = trace_ring[trace_next.fetch_add(1, std::memory_order_relaxed) & (TRACE_RING_SIZE - 1)];
+        event.name = name_;
+        event.start_ns = start_;
+        event.duration_ns = monotonic_ns() - start_;
+        event.tid = tid;
+    }
+
+private:
+    const char *name_;
+    int64_t start_;
+};
+
+// Write the trace ring to logs/trace-<pid>-<time>.json, loadable in chrome://tracing or Perfetto
+void dump_trace(const int worker) {
+    const uint64_t end = trace_next.load();
+    const uint64_t begin = end > TRACE_RING_SIZE ? end - TRACE_RING_SIZE : 0;
+    const std::string path = "logs/trace-" + std::to_string(getpid()) + "-" + std::to_string(std::time(nullptr)) + ".json";
+    FILE *out = fopen(path.c_str(), "w");
+    if (!out) {
+        perror("fopen");
+        return;
+    }
+    fprintf(out, "{\"traceEvents\":[\n");
+    fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"worker %d\"}}",
+            getpid(), worker);
+    for (uint64_t i = begin; i < end; i++) {
+        const TraceEvent &event = trace_ring[i & (TRACE_RING_SIZE - 1)];
+        if (!event.name) continue;
+        fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"http\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d}",
+                event.name, event.start_ns / 1000.0, event.duration_ns / 1000.0, getpid(), event.tid);
+    }
+    fprintf(out, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(out);
+    std::cerr << "Trace written to " << path << std::endl;
+}
+
+// Stack captured by the SIGPROF handler, depth is published last so the flush only reads complete samples
+struct ProfileSample {
+    void *frames[PROFILER_MAX_DEPTH];
+    std::atomic<int> depth;
+};
+
+// Per-process sampling profiler state, samples are preallocated so the signal handler never allocates
+ProfileSample profile_samples[PROFILER_MAX_SAMPLES];
+std::atomic<uint32_t> profile_next{0};
+std::atomic<int> profile_handlers_running{0};
+std::atomic<uint64_t> profile_dropped{0};
+bool profiler_running = false;
+volatile sig_atomic_t profiler_toggle_requested = 0;
+
+void request_profiler_toggle(int) {
+    profiler_toggle_requested = 1;
+}
+
+void profiler_sample(int) {
+    const int saved_errno = errno;
+    profile_handlers_running++;
+    const uint32_t index = profile_next.fetch_add(1);
+    if (index < PROFILER_MAX_SAMPLES) {
+        ProfileSample &sample = profile_samples[index];
+        const int depth = backtrace(sample.frames, PROFILER_MAX_DEPTH);
+        sample.depth.store(depth, std::memory_order_release);
+    } else {
+        profile_dropped++;
+    }
+    profile_handlers_running--;
+    errno = saved_errno;
+}
+
+void set_profiler_timer(const bool enabled) {
+    itimerval timer{};
+    if (enabled) {
+        timer.it_interval.tv_usec = 1000000 / config().profiler_hz;
+        timer.it_value = timer.it_interval;
+    }
+    setitimer(ITIMER_PROF, &timer, nullptr);
+}
+
+void start_profiler() {
+    void *warmup[1];
+    backtrace(warmup, 1); // the first backtrace() loads libgcc, which must not happen inside the handler
+
+    struct sigaction action{};
+    action.sa_handler = profiler_sample;
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGPROF, &action, nullptr);
+    set_profiler_timer(true);
+    profiler_running = true;
+}
+
+std::string symbolize(void *address) {
+    Dl_info info{};
+    if (dladdr(address, &info) && info.dli_sname) {
+        int status = 0;
+        char *demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        std::string name = status == 0 && demangled ? demangled : info.dli_sname;
+        free(demangled);
+        std::replace(name.begin(), name.end(), ';', ':'); // ';' separates frames in the folded format
+        return name;
+    }
+    char buf[32];
+    snprintf(buf, sizeof(buf), "0x%lx", reinterpret_cast<unsigned long>(address));
+    return buf;
 }
 
-void log_event(const std::string &message, int msg_queue_id, const std::string &client_ip = "", int client_port = 0) {
+// Append the collected samples to logs/profile-<pid>.folded in the folded-stack format read by
+// flamegraph.pl ("root;caller;callee count"). The timer is paused while the buffer is drained.
+void flush_profile() {
+    set_profiler_timer(false);
+    while (profile_handlers_running.load() > 0) {
+    }
+
+    std::map<std::string, uint64_t> stacks;
+    const uint32_t collected = std::min<uint32_t>(profile_next.load(), PROFILER_MAX_SAMPLES);
+    for (uint32_t i = 0; i < collected; i++) {
+        ProfileSample &sample = profile_samples[i];
+        const int depth = sample.depth.exchange(0, std::memory_order_acquire);
+        // Frames 0 and 1 are the handler and the kernel's signal trampoline
+        std::string stack;
+        for (int frame = depth - 1; frame >= 2; frame--) {
+            if (!stack.empty()) stack += ';';
+            stack += symbolize(sample.frames[frame]);
+        }
+        if (!stack.empty()) stacks[stack]++;
+    }
+    profile_next.store(0);
+
+    if (!stacks.empty()) {
+        const std::string path = "logs/profile-" + std::to_string(getpid()) + ".folded";
+        std::ofstream out(path, std::ios::app);
+        for (const auto &[stack, count]: stacks) {
+            out << stack << " " << count << "\n";
+        }
+    }
+    if (profile_dropped.load() > 0) {
+        std::cerr << "Profiler dropped " << profile_dropped.exchange(0) << " samples, raise PROFILER_MAX_SAMPLES" << std::endl;
+    }
+    set_profiler_timer(profiler_running);
+}
+
+// Take a token from the client's bucket, false when the client exceeded its rate. Clients hash to a
+// short probe window; an unknown client replaces the least recently seen entry of that window.
+bool rate_limit_allow(const uint32_t client_addr) {
+    if (config().rate_limit_rps <= 0) return true;
+
+    const int64_t now = monotonic_ns();
+    const size_t start = (client_addr * 2654435761U) & (config().rate_limit_buckets - 1);
+    RateBucket *bucket = nullptr;
+    for (size_t probe = 0; probe < 4; probe++) {
+        RateBucket *candidate = &rate_buckets[(start + probe) & (config().rate_limit_buckets - 1)];
+        if (candidate->client_addr == client_addr) {
+            bucket = candidate;
+            break;
+        }
+        if (!bucket || candidate->updated_ns < bucket->updated_ns) {
+            bucket = candidate;
+        }
+    }
+
+    while (bucket->lock.test_and_set(std::memory_order_acquire)) {
+    }
+    if (bucket->client_addr != client_addr) {
+        bucket->client_addr = client_addr;
+        bucket->tokens = config().rate_limit_burst;
+    } else {
+        const double refill = (now - bucket->updated_ns) * (config().rate_limit_rps / 1e9);
+        bucket->tokens = std::min<double>(config().rate_limit_burst, bucket->tokens + refill);
+    }
+    bucket->updated_ns = now;
+    const bool allowed = bucket->tokens >= 1.0;
+    if (allowed) bucket->tokens -= 1.0;
+    bucket->lock.clear(std::memory_order_release);
+    return allowed;
+}
+
+// CPUs the server may run on, the first one is the housekeeping core for the master and logger
+std::vector<int> server_cpus;
+
+std::vector<int> allowed_cpus() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+void pin_to_cpus(const std::vector<int> &cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (const int cpu: cpus) CPU_SET(cpu, &set);
+    if (!cpus.empty() && sched_setaffinity(0, sizeof(set), &set) == -1) {
+        perror("sched_setaffinity");
+    }
+}
+
+// Cores of a worker: an equal contiguous share of the non-housekeeping cores (contiguous cores usually
+// belong to the same NUMA node), or a single shared core when there are more workers than cores
+std::vector<int> worker_cpus(const int worker) {
+    if (server_cpus.size() < 2) return server_cpus;
+    const size_t available = server_cpus.size() - 1;
+    const size_t share = std::max<size_t>(1, available / config().workers);
+    const size_t first = 1 + (worker * share) % available;
+    return std::vector<int>(server_cpus.begin() + first, server_cpus.begin() + std::min(first + share, server_cpus.size()));
+}
+
+// Worker pinned to the given core, -1 for the housekeeping core or an unknown core
+int worker_for_cpu(const int cpu) {
+    if (server_cpus.empty()) return -1;
+    for (int i = 0; i < config().workers; i++) {
+        for (const int worker_cpu: worker_cpus(i)) {
+            if (worker_cpu == cpu && worker_cpu != server_cpus[0]) return i;
+        }
+    }
+    return -1;
+}
+
+// Move a freshly forked worker to its cores and make its future allocations local to their NUMA node,
+// overriding any interleave policy inherited from the launcher. Pages written after the fork are copied
+// on first touch, so the worker's buffers and thread stacks end up on the local node.
+void place_worker(const int worker) {
+    if (!config().cpu_affinity) return;
+    pin_to_cpus(worker_cpus(worker));
+    if (syscall(SYS_set_mempolicy, MPOL_LOCAL, nullptr, 0) == -1) {
+        perror("set_mempolicy");
+    }
+}
+
+// Allocate zeroed memory shared with the processes forked afterwards
+template<typename T>
+T *create_shared(const size_t count = 1) {
+    void *mem = mmap(nullptr, sizeof(T) * count, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+    return static_cast<T *>(mem);
+}
+
+// A response to early data is written while the handshake is still open, as 0.5-RTT data
+bool TlsRecordWriter::write_record(const char *data, size_t len) {
+    if (!SSL_is_init_finished(ssl_)) {
+        size_t written = 0;
+        return SSL_write_early_data(ssl_, data, len, &written) > 0;
+    }
+    return SSL_write(ssl_, data, static_cast<int>(len)) > 0;
+}
+
+bool TlsRecordWriter::write(const char *data, size_t len) {
+    const ServerConfig &settings = config();
+    if (!settings.tls_dynamic_records) {
+        return write_record(data, len);
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    if (small_records_ >= settings.tls_record_boost_count &&
+        now - last_write_ > std::chrono::milliseconds(settings.tls_record_idle_ms)) {
+        small_records_ = 0;
+        server_metrics->tls_record_idle_resets++;
+    }
+    last_write_ = now;
+
+    while (len > 0) {
+        const bool small = small_records_ < settings.tls_record_boost_count;
+        const size_t record = std::min(len, static_cast<size_t>(small ? settings.tls_record_small
+                                                                      : settings.tls_record_large));
+        if (!write_record(data, record)) {
+            return false;
+        }
+        if (small) {
+            small_records_++;
+            server_metrics->tls_records_small++;
+        } else {
+            server_metrics->tls_records_large++;
+        }
+        data += record;
+        len -= record;
+    }
+    return true;
+}
+
+// Heap allocations made by the current thread through operator new or for arena chunks, lets the worker
+// check that its own request path is heap-free. malloc calls made directly, by OpenSSL, stdio or libc for
+// instance, are not counted.
+thread_local uint64_t heap_allocations = 0;
+
+void *operator new(const size_t size) {
+    heap_allocations++;
+    if (void *ptr = malloc(size ? size : 1)) return ptr;
+    throw std::bad_alloc();
+}
+
+void *operator new(const size_t size, const std::align_val_t alignment) {
+    heap_allocations++;
+    const size_t align = static_cast<size_t>(alignment);
+    if (void *ptr = aligned_alloc(align, (std::max<size_t>(size, 1) + align - 1) / align * align)) return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept {
+    free(ptr);
+}
+
+// Bump allocator for everything a request creates. Deallocation is a no-op and reset() rewinds the
+// arena after the request. Chunks grown during a request are merged into one on reset and kept, so
+// after warm-up a request is served without calling malloc at all.
+class RequestArena : public std::pmr::memory_resource {
+public:
+    explicit RequestArena(const size_t initial_size) : initial_size_(initial_size) {
+        add_chunk(initial_size);
+    }
+
+    ~RequestArena() override {
+        for (size_t i = 0; i < chunk_count_; i++) free(chunks_[i].data);
+    }
+
+    RequestArena(const RequestArena &) = delete;
+    RequestArena &operator=(const RequestArena &) = delete;
+
+    void reset() {
+        if (chunk_count_ > 1 || chunks_[0].size > config().request_arena_max_retained) {
+            size_t total = 0;
+            for (size_t i = 0; i < chunk_count_; i++) {
+                total += chunks_[i].size;
+                free(chunks_[i].data);
+            }
+            chunk_count_ = 0;
+            add_chunk(total > config().request_arena_max_retained ? initial_size_ : total);
+        }
+        current_ = 0;
+        used_ = 0;
+    }
+
+private:
+    struct Chunk {
+        char *data;
+        size_t size;
+    };
+
+    void add_chunk(const size_t size) {
+        char *data = static_cast<char *>(malloc(size));
+        if (!data || chunk_count_ == std::size(chunks_)) throw std::bad_alloc();
+        chunks_[chunk_count_++] = {data, size};
+        heap_allocations++;
+        server_metrics->arena_chunk_allocations++;
+    }
+
+    void *do_allocate(const size_t bytes, const size_t alignment) override {
+        size_t offset = align(used_, alignment);
+        while (offset + bytes > chunks_[current_].size) {
+            if (current_ + 1 == chunk_count_) {
+                add_chunk(std::max(bytes + alignment, chunks_[current_].size * 2));
+            }
+            current_++;
+            offset = align(0, alignment);
+        }
+        used_ = offset + bytes;
+        return chunks_[current_].data + offset;
+    }
+
+    // Offset in the current chunk at or after `offset` whose address has the requested alignment
+    size_t align(const size_t offset, const size_t alignment) const {
+        const auto address = reinterpret_cast<uintptr_t>(chunks_[current_].data) + offset;
+        return offset + ((alignment - address % alignment) % alignment);
+    }
+
+    void do_deallocate(void *, size_t, size_t) override {
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+        return this == &other;
+    }
+
+    size_t initial_size_;
+    Chunk chunks_[32]{};
+    size_t chunk_count_ = 0;
+    size_t current_ = 0;
+    size_t used_ = 0;
+};
+
+std::pmr::string arena_concat(RequestArena &arena, std::initializer_list<std::string_view> parts) {
+    size_t length = 0;
+    for (const auto part: parts) length += part.size();
+    std::pmr::string result(&arena);
+    result.reserve(length);
+    for (const auto part: parts) result.append(part);
+    return result;
+}
+
+// Blocking FIFO shared by the handshake and request threads of a worker
+template<typename T>
+class WorkQueue {
+public:
+    void push(T item) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            items_.push_back(std::move(item));
+        }
+        ready_.notify_one();
+    }
+
+    T pop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait(lock, [this] { return !items_.empty(); });
+        T item = std::move(items_.front());
+        items_.pop_front();
+        return item;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<T> items_;
+};
+
+// Worker index of this process, -1 in the master and the logger
+int current_worker = -1;
+
+// Hand a record to the logger. Formatting happens in the logger, the caller only copies the text.
+void send_log_record(LogRecord &record, const std::string_view message, const std::string_view detail,
+                     const int msg_queue_id) {
     LogMessage log_msg{};
     log_msg.mtype = 1;
+    const size_t message_len = std::min(message.size(), sizeof(log_msg.text) - 1);
+    memcpy(log_msg.text, message.data(), message_len);
+    record.detail_len = std::min(detail.size(), sizeof(log_msg.text) - message_len - 1);
+    memcpy(log_msg.text + message_len + 1, detail.data(), record.detail_len);
+
+    record.timestamp_ns = monotonic_ns();
+    record.pid = getpid();
+    record.type = BINLOG_EVENT;
+    log_msg.record = record;
+    msgsnd(msg_queue_id, &log_msg, sizeof(LogRecord) + message_len + 1 + record.detail_len, 0);
+}
 
-    std::ostringstream log_stream;
-    log_stream << "[" << get_timestamp() << "] [PID: " << getpid() << "]";
-    if (!client_ip.empty()) {
-        log_stream << " [Client: " << client_ip << ":" << client_port << "]";
+// Log an event; `detail` is the variable part appended to the fixed message
+void log_event(const std::string_view message, const int msg_queue_id, const ClientConnection *conn = nullptr,
+               const std::string_view detail = {}, const int worker = current_worker) {
+    LogRecord record{};
+    record.worker = static_cast<int16_t>(worker);
+    if (conn) {
+        record.client_addr = conn->addr;
+        record.client_port = conn->port;
     }
-    log_stream << " " << message;
+    send_log_record(record, message, detail, msg_queue_id);
+}
 
-    strncpy(log_msg.message, log_stream.str().c_str(), sizeof(log_msg.message) - 1);
-    log_msg.message[sizeof(log_msg.message) - 1] = '\0';
-    printf("%s\n", log_msg.message);
-    msgsnd(msg_queue_id, &log_msg, sizeof(log_msg.message), 0);
+volatile sig_atomic_t reload_requested = 0;
+
+void request_reload(int) {
+    reload_requested = 1;
+}
+
+// Re-read the configuration file and publish it as the new snapshot. Settings marked restart-only
+// keep their running values; with `report` set, changes to them and parse errors are logged.
+void reload_config(const int msg_queue_id, const bool report) {
+    auto next = std::make_unique<ServerConfig>();
+    std::string error;
+    if (!parse_config(config_path, *next, error)) {
+        if (report) log_event("Configuration not reloaded: ", msg_queue_id, nullptr, error);
+        return;
+    }
+
+    const ServerConfig &running = config();
+    for (const ConfigOption &option: config_options) {
+        if (!option.restart) continue;
+        std::visit([&](auto field) {
+            if ((*next).*field == running.*field) return;
+            if (report) log_event("Configuration change needs a restart: ", msg_queue_id, nullptr, option.key);
+            (*next).*field = running.*field;
+        }, option.field);
+    }
+    if (next->proxy_routes != running.proxy_routes) {
+        if (report) log_event("Configuration change needs a restart: ", msg_queue_id, nullptr, "proxy");
+        next->proxy_routes = running.proxy_routes;
+    }
+    current_config.store(next.release(), std::memory_order_release);
+    if (report) log_event("Configuration reloaded from ", msg_queue_id, nullptr, config_path);
+}
+
+// Access log record for a completed request
+void log_access(const ClientConnection &conn, const int status, const size_t bytes, const std::string_view request_line,
+                const int msg_queue_id) {
+    LogRecord record{};
+    record.worker = static_cast<int16_t>(current_worker);
+    record.client_addr = conn.addr;
+    record.client_port = conn.port;
+    record.status = status;
+    record.bytes = static_cast<uint32_t>(std::min<size_t>(bytes, UINT32_MAX));
+    record.latency_us = static_cast<uint32_t>((monotonic_ns() - conn.accepted_ns) / 1000);
+    send_log_record(record, "Worker handled SSL client: ", request_line, msg_queue_id);
+}
+
+int64_t realtime_ns() {
+    timespec ts{};
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Binary log writer, interns message texts per file so events only carry their id
+class BinlogWriter {
+public:
+    explicit BinlogWriter(std::ofstream &file) : file_(file) {
+        BinlogFileHeader header{};
+        memcpy(header.magic, BINLOG_MAGIC, sizeof(header.magic));
+        header.version = BINLOG_VERSION;
+        header.record_size = sizeof(LogRecord);
+        header.monotonic_ns = monotonic_ns();
+        header.wall_clock_ns = realtime_ns();
+        file_.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    }
+
+    // Returns the number of bytes appended to the file
+    size_t write(LogRecord record, const std::string_view message, const char *detail) {
+        size_t written = 0;
+        auto it = message_ids_.find(message);
+        if (it == message_ids_.end()) {
+            if (message_ids_.size() == UINT16_MAX) message_ids_.clear();
+            it = message_ids_.emplace(message, static_cast<uint16_t>(message_ids_.size())).first;
+            LogRecord definition{};
+            definition.type = BINLOG_STRING;
+            definition.message_id = it->second;
+            definition.detail_len = static_cast<uint16_t>(message.size());
+            file_.write(reinterpret_cast<const char *>(&definition), sizeof(definition));
+            file_.write(message.data(), static_cast<std::streamsize>(message.size()));
+            written += sizeof(definition) + message.size();
+        }
+        record.message_id = it->second;
+        file_.write(reinterpret_cast<const char *>(&record), sizeof(record));
+        file_.write(detail, record.detail_len);
+        return written + sizeof(record) + record.detail_len;
+    }
+
+private:
+    std::ofstream &file_;
+    std::map<std::string, uint16_t, std::less<>> message_ids_;
+};
+
+// Rotated log segments in logs/, oldest first since their names embed the rotation time
+std::vector<std::string> rotated_log_segments() {
+    std::vector<std::string> segments;
+    for (const auto &entry: std::filesystem::directory_iterator("logs")) {
+        const std::string name = entry.path().filename().string();
+        if (name.rfind("log-", 0) == 0) segments.push_back(entry.path().string());
+    }
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+// Replace a rotated segment with its gzip-compressed copy
+bool compress_log_segment(const std::string &path) {
+    const std::string gz_path = path + ".gz";
+    const std::string tmp_path = gz_path + ".tmp";
+    FILE *in = fopen(path.c_str(), "rb");
+    if (!in) return false;
+    gzFile out = gzopen(tmp_path.c_str(), "wb6");
+    if (!out) {
+        fclose(in);
+        return false;
+    }
+
+    bool ok = true;
+    char buffer[65536];
+    size_t n;
+    while (ok && (n = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+        ok = gzwrite(out, buffer, static_cast<unsigned>(n)) == static_cast<int>(n);
+    }
+    fclose(in);
+    ok = gzclose(out) == Z_OK && ok;
+    if (!ok || rename(tmp_path.c_str(), gz_path.c_str()) == -1) {
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    unlink(path.c_str());
+    return true;
+}
+
+// Background thread of the logger: compresses rotated segments and enforces the retention limit,
+// keeping slow file work away from the loop that drains the message queue
+void log_segment_worker(WorkQueue<std::string> &rotated) {
+    while (true) {
+        const std::string path = rotated.pop();
+        if (config().log_compress && path.size() > 3 && path.compare(path.size() - 3, 3, ".gz") != 0 &&
+            !compress_log_segment(path)) {
+            std::cerr << "Failed to compress " << path << std::endl;
+        }
+
+        std::vector<std::string> segments = rotated_log_segments();
+        for (size_t i = 0; i + config().log_retain_segments < segments.size(); i++) {
+            unlink(segments[i].c_str());
+        }
+    }
 }
 
+// Active log of the logger process, rotated by size and age. Rotation only renames the file and
+// opens a new one; compression and retention run on the segment thread.
+class LogFile {
+public:
+    explicit LogFile(WorkQueue<std::string> &rotated) : rotated_(rotated) {
+        open();
+    }
+
+    void write(const LogMessage &log_msg) {
+        const char *message = log_msg.text;
+        const char *detail = message + strlen(message) + 1;
+        if (binlog_) {
+            bytes_ += binlog_->write(log_msg.record, message, detail);
+        } else {
+            char line[1024];
+            const int length = format_log_text(line, sizeof(line), log_msg.record, message, detail, wall_offset_ns_);
+            line[length] = '\n';
+            file_.write(line, length + 1);
+            fwrite(line, 1, length + 1, stdout);
+            bytes_ += length + 1;
+        }
+    }
+
+    void flush() {
+        file_.flush();
+    }
+
+    void rotate_if_due() {
+        const ServerConfig &settings = config();
+        const bool too_big = settings.log_rotate_bytes > 0 && bytes_ >= settings.log_rotate_bytes;
+        const bool too_old = settings.log_rotate_seconds > 0 &&
+                             std::time(nullptr) - opened_at_ >= settings.log_rotate_seconds;
+        if (!too_big && !too_old) return;
+        if (bytes_ == (binlog_ ? sizeof(BinlogFileHeader) : 0)) {
+            opened_at_ = std::time(nullptr); // nothing logged, keep the file
+            return;
+        }
+
+        file_.close();
+        timespec now{};
+        clock_gettime(CLOCK_REALTIME, &now);
+        std::tm local_time{};
+        localtime_r(&now.tv_sec, &local_time);
+        char segment[64];
+        const size_t length = std::strftime(segment, sizeof(segment), "logs/log-%Y%m%d-%H%M%S", &local_time);
+        snprintf(segment + length, sizeof(segment) - length, "-%03ld%s", now.tv_nsec / 1000000,
+                 binary_ ? ".bin" : ".txt");
+        if (rename(path(), segment) == 0) {
+            rotated_.push(segment);
+        } else {
+            perror("rename");
+        }
+        open();
+    }
+
+    // Reopen after an external tool moved the file away or the log format changed (SIGHUP)
+    void reopen() {
+        file_.close();
+        open();
+    }
+
+private:
+    const char *path() const {
+        return binary_ ? "logs/log.bin" : "logs/log.txt";
+    }
+
+    // The format is chosen per file, a reload switches it at the next reopen or rotation
+    void open() {
+        binary_ = config().log_binary;
+        binlog_.reset();
+        file_.open(path(), std::ios::app | std::ios::binary);
+        if (!file_) {
+            std::cerr << "Failed to open log file." << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        struct stat file_stat{};
+        bytes_ = stat(path(), &file_stat) == 0 ? file_stat.st_size : 0;
+        opened_at_ = std::time(nullptr);
+        wall_offset_ns_ = realtime_ns() - monotonic_ns();
+        if (binary_) {
+            binlog_.emplace(file_);
+            bytes_ += sizeof(BinlogFileHeader);
+        }
+    }
+
+    WorkQueue<std::string> &rotated_;
+    std::ofstream file_;
+    std::optional<BinlogWriter> binlog_;
+    bool binary_ = false;
+    uint64_t bytes_ = 0;
+    std::time_t opened_at_ = 0;
+    int64_t wall_offset_ns_ = 0;
+};
+
+// Interrupts the logger's blocking msgrcv, the main loop then checks for a due rotation
+void log_rotation_tick(int) {}
+
 void logger_process() {
-    const int msg_queue_id = msgget(LOG_MSG_QUEUE_KEY, IPC_CREAT | 0666);
+    const int msg_queue_id = msgget(config().log_msg_queue_key, IPC_CREAT | 0666);
     if (msg_queue_id == -1) {
         perror("msgget");
         exit(EXIT_FAILURE);
     }
 
-    if (!std::filesystem::exists("logs")) {
-        std::filesystem::create_directory("logs");
+    if (!std::filesystem::exists("logs")) {
+        std::filesystem::create_directory("logs");
+    }
+
+    // SIGHUP reloads the configuration and reopens the log, installed without SA_RESTART so it
+    // interrupts a blocked msgrcv
+    struct sigaction reload_action{};
+    reload_action.sa_handler = request_reload;
+    sigaction(SIGHUP, &reload_action, nullptr);
+
+    // msgrcv has no timeout: a once-a-second SIGALRM, also without SA_RESTART, lets an idle logger
+    // rotate its log by age
+    struct sigaction tick_action{};
+    tick_action.sa_handler = log_rotation_tick;
+    sigaction(SIGALRM, &tick_action, nullptr);
+    const itimerval tick{{1, 0}, {1, 0}};
+    setitimer(ITIMER_REAL, &tick, nullptr);
+
+    // Both signals are meant for the msgrcv of this thread, the segment worker blocks them
+    sigset_t wakeups;
+    sigemptyset(&wakeups);
+    sigaddset(&wakeups, SIGHUP);
+    sigaddset(&wakeups, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &wakeups, nullptr);
+    WorkQueue<std::string> rotated;
+    std::thread(log_segment_worker, std::ref(rotated)).detach();
+    pthread_sigmask(SIG_UNBLOCK, &wakeups, nullptr);
+
+    // Pick up segments a previous logger rotated but did not get to compress
+    for (const std::string &segment: rotated_log_segments()) {
+        if (segment.size() > 4 && segment.compare(segment.size() - 4, 4, ".tmp") == 0) {
+            unlink(segment.c_str());
+        } else if (segment.compare(segment.size() - 3, 3, ".gz") != 0) {
+            rotated.push(segment);
+        }
+    }
+
+    LogFile log_file(rotated);
+    LogMessage log_msg{};
+    while (true) {
+        if (reload_requested) {
+            reload_requested = 0;
+            reload_config(msg_queue_id, false);
+            log_file.reopen();
+        }
+        log_file.rotate_if_due();
+
+        // Drain the queue without blocking and only flush once it runs empty
+        if (msgrcv(msg_queue_id, &log_msg, sizeof(log_msg) - sizeof(long), 0, IPC_NOWAIT) == -1) {
+            if (errno == ENOMSG) {
+                log_file.flush();
+                if (msgrcv(msg_queue_id, &log_msg, sizeof(log_msg) - sizeof(long), 0, 0) != -1) goto received;
+            }
+            if (errno != EINTR) perror("msgrcv");
+            continue;
+        }
+    received:
+        log_file.write(log_msg);
+    }
+}
+
+// Append a file's contents to `content`, false if it cannot be read. Reads straight into the
+// destination string, which lets the request path place file data in its arena.
+template<typename String>
+bool read_file(const char *file_path, String &content) {
+    TraceSpan span("read_file");
+    const int fd = open(file_path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return false;
+    struct stat file_stat{};
+    if (fstat(fd, &file_stat) == -1 || !S_ISREG(file_stat.st_mode)) {
+        close(fd);
+        return false;
+    }
+    const size_t start = content.size();
+    content.resize(start + file_stat.st_size);
+    size_t done = 0;
+    while (done < static_cast<size_t>(file_stat.st_size)) {
+        const ssize_t n = read(fd, content.data() + start + done, file_stat.st_size - done);
+        if (n <= 0) break;
+        done += n;
+    }
+    content.resize(start + done);
+    close(fd);
+    return true;
+}
+
+std::string read_file(const char *file_path) {
+    std::string content;
+    read_file(file_path, content);
+    return content;
+}
+
+// Request target of the request line, a view into the request buffer
+std::string_view parse_http_request(const std::string_view request) {
+    const size_t method_end = request.find(' ');
+    if (method_end == std::string_view::npos) return {};
+    const size_t path_start = request.find_first_not_of(' ', method_end);
+    if (path_start == std::string_view::npos) return {};
+    const size_t path_end = request.find_first_of(" \r\n", path_start);
+    return request.substr(path_start, path_end == std::string_view::npos ? path_end : path_end - path_start);
+}
+
+const char *get_content_type(const std::string_view path) {
+    const std::string_view extension = path.substr(path.find_last_of('.') + 1);
+    if (extension == "html" || extension == "htm") return "text/html";
+    if (extension == "css") return "text/css";
+    if (extension == "js") return "application/javascript";
+    if (extension == "json") return "application/json";
+    if (extension == "jpg" || extension == "jpeg") return "image/jpeg";
+    if (extension == "png") return "image/png";
+    if (extension == "gif") return "image/gif";
+    if (extension == "pdf") return "application/pdf";
+    return "text/plain";
+}
+
+void handle_php_request(const std::pmr::string &php_path, std::pmr::string &response, RequestArena &arena) {
+    TraceSpan span("php_request");
+    int pipefd[2];
+    if (pipe(pipefd) == -1) {
+        perror("pipe");
+        response = "HTTP/1.1 500 Internal Server Error\r\nContent-Type: text/html\r\nConnection: close\r\n\r\n";
+        return;
+    }
+
+    const pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        response = "HTTP/1.1 500 Internal Server Error\r\nContent-Type: text/html\r\nConnection: close\r\n\r\n";
+        return;
+    }
+
+    if (pid == 0) {
+        close(pipefd[0]);
+        dup2(pipefd[1], STDOUT_FILENO);
+        close(pipefd[1]);
+
+        char *args[] = {(char *) "/usr/bin/php-cgi", (char *) php_path.c_str(), nullptr};
+        execvp("/usr/bin/php-cgi", args);
+        perror("execvp");
+        exit(EXIT_FAILURE);
+    } else {
+        close(pipefd[1]);
+        // Output is appended after the headers, which are dropped again if php-cgi produced nothing
+        response = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nConnection: close\r\n\r\n";
+        const size_t header_size = response.size();
+        const size_t buffer_size = config().php_buffer_size;
+        char *buffer = static_cast<char *>(arena.allocate(buffer_size, 1));
+        ssize_t n;
+        {
+            // Time until php-cgi produces its first output, dominated by interpreter startup
+            TraceSpan startup_span("php_startup");
+            n = read(pipefd[0], buffer, buffer_size);
+        }
+        while (n > 0) {
+            response.append(buffer, n);
+            n = read(pipefd[0], buffer, buffer_size);
+        }
+        close(pipefd[0]);
+        waitpid(pid, nullptr, 0);
+
+        if (response.size() == header_size) {
+            response = "HTTP/1.1 500 Internal Server Error\r\nContent-Type: text/html\r\nConnection: close\r\n\r\n";
+        }
+    }
+}
+
+// Safe requests may be answered from 0-RTT data: idempotent methods on static files only
+bool is_early_data_safe(const std::string_view method, const std::string_view path, const std::string_view request) {
+    if (method != "GET" && method != "HEAD") return false;
+    if (path.find(".php") != std::string_view::npos || path.find('?') != std::string_view::npos) return false;
+    if (path == config().status_path) return false;
+    return request.find("Content-Length: ") == std::string_view::npos;
+}
+
+// Discard the rest of the early data, the handshake cannot complete while some is still unread
+bool drain_early_data(SSL *ssl) {
+    char discard[1024];
+    while (true) {
+        size_t read_bytes = 0;
+        const int status = SSL_read_early_data(ssl, discard, sizeof(discard), &read_bytes);
+        if (status == SSL_READ_EARLY_DATA_ERROR) {
+            return false;
+        }
+        if (status == SSL_READ_EARLY_DATA_FINISH) {
+            return true;
+        }
+    }
+}
+
+void append_format(std::pmr::string &out, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+void append_format(std::pmr::string &out, const char *format, ...) {
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    const int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    out.append(line, std::min<size_t>(std::max(length, 0), sizeof(line) - 1));
+}
+
+void render_server_status(std::pmr::string &response) {
+    response = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nConnection: close\r\n\r\n";
+    const std::pair<const char *, const std::atomic<uint64_t> &> counters[] = {
+        {"early_data_accepted", server_metrics->early_data_accepted},
+        {"early_data_rejected", server_metrics->early_data_rejected},
+        {"early_data_replayed", server_metrics->early_data_replayed},
+        {"tls_records_small", server_metrics->tls_records_small},
+        {"tls_records_large", server_metrics->tls_records_large},
+        {"tls_record_idle_resets", server_metrics->tls_record_idle_resets},
+        {"rate_limited", server_metrics->rate_limited},
+        {"arena_requests", server_metrics->arena_requests},
+        {"arena_chunk_allocations", server_metrics->arena_chunk_allocations},
+        {"request_heap_allocations", server_metrics->request_heap_allocations},
+        {"requests_with_heap_allocations", server_metrics->requests_with_heap_allocations},
+        {"proxy_requests", server_metrics->proxy_requests},
+        {"proxy_errors", server_metrics->proxy_errors},
+        {"proxy_connections_opened", server_metrics->proxy_connections_opened},
+        {"proxy_connections_reused", server_metrics->proxy_connections_reused},
+    };
+    for (const auto &[name, value]: counters) {
+        append_format(response, "%s %lu\n", name, static_cast<unsigned long>(value.load()));
+    }
+    const int64_t now = monotonic_ns();
+    for (int i = 0; i < config().workers; i++) {
+        const WorkerSlot &slot = worker_slots[i];
+        append_format(response, "worker_%d pid=%d in_flight=%d served=%lu heartbeat_age_ms=%ld\n", i,
+                      slot.pid.load(), slot.in_flight.load(), static_cast<unsigned long>(slot.requests_served.load()),
+                      static_cast<long>((now - slot.heartbeat_ns.load()) / 1000000));
+    }
+}
+
+// Upstream of a proxy route. Forked workers each get their own copy, so the pool of idle
+// keep-alive connections and the health state are per worker.
+struct ProxyUpstream {
+    std::string prefix;
+    std::string address;
+    sockaddr_storage addr{};
+    socklen_t addr_len = 0;
+    std::mutex pool_mutex;
+    std::vector<int> idle_fds;
+    std::atomic<bool> healthy{true};
+    int64_t last_check_ns = 0;
+};
+
+std::deque<ProxyUpstream> proxy_upstreams;
+
+// Resolve the configured proxy routes, called by the master before the workers are forked
+void setup_proxy_upstreams() {
+    for (const auto &[prefix, address]: config().proxy_routes) {
+        ProxyUpstream &upstream = proxy_upstreams.emplace_back();
+        upstream.prefix = prefix;
+        upstream.address = address;
+        upstream.idle_fds.reserve(config().proxy_pool_size);
+
+        if (address.rfind("unix:", 0) == 0) {
+            sockaddr_un un{};
+            un.sun_family = AF_UNIX;
+            strncpy(un.sun_path, address.c_str() + 5, sizeof(un.sun_path) - 1);
+            memcpy(&upstream.addr, &un, sizeof(un));
+            upstream.addr_len = sizeof(un);
+            continue;
+        }
+
+        const size_t colon = address.rfind(':');
+        addrinfo hints{};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo *result = nullptr;
+        if (colon == std::string::npos ||
+            getaddrinfo(address.substr(0, colon).c_str(), address.c_str() + colon + 1, &hints, &result) != 0) {
+            std::cerr << "Invalid proxy upstream " << address << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        memcpy(&upstream.addr, result->ai_addr, result->ai_addrlen);
+        upstream.addr_len = result->ai_addrlen;
+        freeaddrinfo(result);
+    }
+}
+
+ProxyUpstream *find_proxy_upstream(const std::string_view path) {
+    for (ProxyUpstream &upstream: proxy_upstreams) {
+        if (path.substr(0, upstream.prefix.size()) == upstream.prefix) return &upstream;
+    }
+    return nullptr;
+}
+
+void set_upstream_health(ProxyUpstream &upstream, const bool healthy, const int msg_queue_id) {
+    if (upstream.healthy.exchange(healthy) != healthy) {
+        log_event(healthy ? "Proxy upstream is back up: " : "Proxy upstream is down: ", msg_queue_id, nullptr,
+                  upstream.address);
+    }
+}
+
+// Connect to an upstream within timeout_ms, the socket then uses proxy_timeout_ms for I/O
+int proxy_connect(const ProxyUpstream &upstream, const int timeout_ms) {
+    const int fd = socket(upstream.addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) return -1;
+    if (connect(fd, (const sockaddr *) &upstream.addr, upstream.addr_len) == -1) {
+        pollfd pfd{.fd = fd, .events = POLLOUT, .revents = 0};
+        int error = 0;
+        socklen_t error_len = sizeof(error);
+        if (errno != EINPROGRESS || poll(&pfd, 1, timeout_ms) != 1 ||
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_len) == -1 || error != 0) {
+            close(fd);
+            return -1;
+        }
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+
+    timeval timeout{};
+    timeout.tv_sec = config().proxy_timeout_ms / 1000;
+    timeout.tv_usec = (config().proxy_timeout_ms % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    if (upstream.addr.ss_family == AF_INET) {
+        const int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    server_metrics->proxy_connections_opened++;
+    return fd;
+}
+
+// Take a pooled connection, skipping ones the upstream closed while idle, or open a new one
+int acquire_upstream(ProxyUpstream &upstream, bool &reused, const int msg_queue_id) {
+    while (true) {
+        int fd;
+        {
+            std::lock_guard<std::mutex> lock(upstream.pool_mutex);
+            if (upstream.idle_fds.empty()) break;
+            fd = upstream.idle_fds.back();
+            upstream.idle_fds.pop_back();
+        }
+        pollfd pfd{.fd = fd, .events = POLLIN, .revents = 0};
+        if (poll(&pfd, 1, 0) == 0) {
+            reused = true;
+            server_metrics->proxy_connections_reused++;
+            return fd;
+        }
+        close(fd); // closed by the upstream or unexpected data, either way unusable
+    }
+
+    reused = false;
+    const int fd = proxy_connect(upstream, config().proxy_timeout_ms);
+    set_upstream_health(upstream, fd != -1, msg_queue_id);
+    return fd;
+}
+
+void release_upstream(ProxyUpstream &upstream, const int fd) {
+    {
+        std::lock_guard<std::mutex> lock(upstream.pool_mutex);
+        if (upstream.idle_fds.size() < static_cast<size_t>(config().proxy_pool_size)) {
+            upstream.idle_fds.push_back(fd);
+            return;
+        }
+    }
+    close(fd);
+}
+
+// Probe every upstream once per proxy_health_interval_ms from the worker's housekeeping. A successful
+// probe connection warms an empty pool instead of being thrown away.
+void check_proxy_upstreams(const int msg_queue_id) {
+    const int64_t now = monotonic_ns();
+    for (ProxyUpstream &upstream: proxy_upstreams) {
+        if (now - upstream.last_check_ns < config().proxy_health_interval_ms * 1000000LL) continue;
+        upstream.last_check_ns = now;
+
+        const int fd = proxy_connect(upstream, std::min(config().proxy_timeout_ms, config().proxy_health_interval_ms));
+        set_upstream_health(upstream, fd != -1, msg_queue_id);
+        if (fd == -1) continue;
+        std::unique_lock<std::mutex> lock(upstream.pool_mutex);
+        if (upstream.idle_fds.empty()) {
+            upstream.idle_fds.push_back(fd);
+        } else {
+            lock.unlock();
+            close(fd);
+        }
+    }
+}
+
+// Follows a chunked message body to find where it ends, so the connection can be reused after it
+class ChunkedTracker {
+public:
+    // Number of bytes from `data` that belong to the body, all of them until done()
+    size_t feed(const char *data, const size_t len) {
+        size_t i = 0;
+        while (i < len && state_ != DONE) {
+            const char c = data[i];
+            switch (state_) {
+                case SIZE:
+                    if (c == '\n') {
+                        state_ = remaining_ == 0 ? TRAILER : DATA;
+                        in_extension_ = false;
+                        line_len_ = 0;
+                    } else if (c == ';') {
+                        in_extension_ = true;
+                    } else if (!in_extension_ && isxdigit(static_cast<unsigned char>(c))) {
+                        remaining_ = remaining_ * 16 + (isdigit(static_cast<unsigned char>(c)) ? c - '0' : (c | 0x20) - 'a' + 10);
+                    }
+                    i++;
+                    break;
+                case DATA: {
+                    const size_t n = std::min(len - i, remaining_);
+                    i += n;
+                    remaining_ -= n;
+                    if (remaining_ == 0) state_ = DATA_END;
+                    break;
+                }
+                case DATA_END:
+                    if (c == '\n') state_ = SIZE;
+                    i++;
+                    break;
+                case TRAILER:
+                    if (c == '\n') {
+                        if (line_len_ == 0) state_ = DONE;
+                        line_len_ = 0;
+                    } else if (c != '\r') {
+                        line_len_++;
+                    }
+                    i++;
+                    break;
+                case DONE:
+                    break;
+            }
+        }
+        return i;
+    }
+
+    bool done() const {
+        return state_ == DONE;
+    }
+
+private:
+    enum State { SIZE, DATA, DATA_END, TRAILER, DONE };
+    State state_ = SIZE;
+    size_t remaining_ = 0;
+    size_t line_len_ = 0;
+    bool in_extension_ = false;
+};
+
+// Value of a header in a header block, matched case-insensitively
+std::string_view header_value(const std::string_view head, const std::string_view name) {
+    size_t line_start = head.find("\r\n");
+    while (line_start != std::string_view::npos && line_start + 2 < head.size()) {
+        line_start += 2;
+        const size_t line_end = head.find("\r\n", line_start);
+        const std::string_view line = head.substr(line_start, line_end - line_start);
+        if (line.size() > name.size() && line[name.size()] == ':' &&
+            strncasecmp(line.data(), name.data(), name.size()) == 0) {
+            std::string_view value = line.substr(name.size() + 1);
+            while (!value.empty() && value.front() == ' ') value.remove_prefix(1);
+            return value;
+        }
+        line_start = line_end;
     }
+    return {};
+}
 
-    std::ofstream log_file("logs/log.txt", std::ios::app);
-    if (!log_file) {
-        std::cerr << "Failed to open log file." << std::endl;
-        exit(EXIT_FAILURE);
+bool contains_token(const std::string_view value, const std::string_view token) {
+    for (size_t i = 0; i + token.size() <= value.size(); i++) {
+        if (strncasecmp(value.data() + i, token.data(), token.size()) == 0) return true;
     }
+    return false;
+}
 
-    LogMessage log_msg{};
-    while (true) {
-        if (msgrcv(msg_queue_id, &log_msg, sizeof(log_msg.message), 0, 0) == -1) {
-            perror("msgrcv");
-            continue;
+// Copy a header block minus its hop-by-hop headers, the caller appends its own Connection header
+void copy_end_to_end_headers(const std::string_view head, std::pmr::string &out) {
+    static constexpr std::string_view hop_by_hop[] = {"connection", "keep-alive", "proxy-connection", "te", "upgrade",
+                                                      "expect"};
+    size_t line_start = 0;
+    while (line_start < head.size()) {
+        const size_t line_end = head.find("\r\n", line_start);
+        if (line_end == std::string_view::npos || line_end == line_start) break;
+        const std::string_view line = head.substr(line_start, line_end - line_start);
+        const std::string_view name = line.substr(0, line.find(':'));
+        const bool skip = line_start > 0 && std::any_of(std::begin(hop_by_hop), std::end(hop_by_hop), [&](auto header) {
+            return name.size() == header.size() && strncasecmp(name.data(), header.data(), header.size()) == 0;
+        });
+        if (!skip) {
+            out.append(line);
+            out.append("\r\n");
         }
-        log_file << log_msg.message << std::endl;
+        line_start = line_end + 2;
     }
 }
 
-std::string read_file(const std::string &file_path) {
-    std::ifstream file(file_path);
-    if (!file) return "";
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    return buffer.str();
+bool send_all(const int fd, const char *data, size_t len) {
+    while (len > 0) {
+        const ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        data += n;
+        len -= n;
+    }
+    return true;
 }
 
-std::string parse_http_request(const std::string &request) {
-    std::istringstream request_stream(request);
-    std::string method, path, protocol;
-    request_stream >> method >> path >> protocol;
-    return path;
+// Complete a request's header block, `request` is what the first read returned. On success
+// head_end is the offset at which the body starts in `head`.
+bool read_request_head(SSL *ssl, const std::string_view request, std::pmr::string &head, size_t &head_end) {
+    head = request;
+    char buffer[4096];
+    while ((head_end = head.find("\r\n\r\n")) == std::string::npos) {
+        if (head.size() > config().header_block_limit) return false;
+        const int n = SSL_read(ssl, buffer, sizeof(buffer));
+        if (n <= 0) return false;
+        head.append(buffer, n);
+    }
+    head_end += 4;
+    return true;
 }
 
-std::string get_content_type(const std::string &path) {
-    const std::string extension = path.substr(path.find_last_of('.') + 1);
-    if (extension == "html" || extension == "htm") return "text/html";
-    if (extension == "css") return "text/css";
-    if (extension == "js") return "application/javascript";
-    if (extension == "json") return "application/json";
-    if (extension == "jpg" || extension == "jpeg") return "image/jpeg";
-    if (extension == "png") return "image/png";
-    if (extension == "gif") return "image/gif";
-    if (extension == "pdf") return "application/pdf";
-    return "text/plain";
+struct ProxyResult {
+    int status;
+    size_t bytes;
+};
+
+ProxyResult proxy_error(TlsRecordWriter &writer, const char *status_line) {
+    server_metrics->proxy_errors++;
+    char response[128];
+    const int length = snprintf(response, sizeof(response), "HTTP/1.1 %s\r\nContent-Type: text/html\r\nConnection: close\r\n\r\n",
+                                status_line);
+    writer.write(response, length);
+    return {std::atoi(status_line), static_cast<size_t>(length)};
 }
 
-void handle_php_request(const std::string &php_path, std::string &response) {
-    int pipefd[2];
-    if (pipe(pipefd) == -1) {
-        perror("pipe");
-        response = "HTTP/1.1 500 Internal Server Error\r\nContent-Type: text/html\r\nConnection: close\r\n\r\n";
-        return;
+// Stream the rest of the client's request body to the upstream, `body_start` is what arrived with the headers
+bool forward_request_body(SSL *ssl, const int fd, const std::string_view body_start, const bool chunked,
+                          size_t content_length) {
+    char buffer[16384];
+    if (chunked) {
+        ChunkedTracker tracker;
+        size_t used = tracker.feed(body_start.data(), body_start.size());
+        if (!send_all(fd, body_start.data(), used)) return false;
+        while (!tracker.done()) {
+            const int n = SSL_read(ssl, buffer, sizeof(buffer));
+            if (n <= 0) return false;
+            used = tracker.feed(buffer, n);
+            if (!send_all(fd, buffer, used)) return false;
+        }
+        return true;
     }
 
-    const pid_t pid = fork();
-    if (pid == -1) {
-        perror("fork");
-        response = "HTTP/1.1 500 Internal Server Error\r\nContent-Type: text/html\r\nConnection: close\r\n\r\n";
-        return;
+    const size_t first = std::min(body_start.size(), content_length);
+    if (!send_all(fd, body_start.data(), first)) return false;
+    content_length -= first;
+    while (content_length > 0) {
+        const int n = SSL_read(ssl, buffer, static_cast<int>(std::min(sizeof(buffer), content_length)));
+        if (n <= 0 || !send_all(fd, buffer, n)) return false;
+        content_length -= n;
     }
+    return true;
+}
 
-    if (pid == 0) {
-        close(pipefd[0]);
-        dup2(pipefd[1], STDOUT_FILENO);
-        close(pipefd[1]);
+// Forward a request to its upstream over a pooled keep-alive connection and stream the response back.
+// Neither body is buffered beyond one read; the connection returns to the pool only when the response
+// ended on a message boundary.
+ProxyResult handle_proxy_request(ClientConnection &conn, const std::string_view request, ProxyUpstream &upstream,
+                                 const int msg_queue_id, RequestArena &arena) {
+    TraceSpan span("proxy_request");
+    server_metrics->proxy_requests++;
+    SSL *ssl = conn.ssl;
+    TlsRecordWriter &writer = conn.writer;
+    char buffer[16384];
+
+    // The header block has to be complete before it can be rewritten
+    std::pmr::string head(&arena);
+    size_t head_end;
+    if (!read_request_head(ssl, request, head, head_end)) {
+        return head.size() > config().header_block_limit ? proxy_error(writer, "431 Request Header Fields Too Large")
+                                                : ProxyResult{0, 0};
+    }
+    const std::string_view client_head(head.data(), head_end);
+    const std::string_view body_start(head.data() + head_end, head.size() - head_end);
+    const std::string_view method = client_head.substr(0, client_head.find(' '));
+
+    const bool chunked_request = contains_token(header_value(client_head, "Transfer-Encoding"), "chunked");
+    size_t request_length = 0;
+    const std::string_view length_value = header_value(client_head, "Content-Length");
+    std::from_chars(length_value.data(), length_value.data() + length_value.size(), request_length);
+    const bool has_body = chunked_request || request_length > 0;
+
+    if (!upstream.healthy) return proxy_error(writer, "502 Bad Gateway");
+
+    std::pmr::string upstream_head(&arena);
+    upstream_head.reserve(head_end + 128);
+    copy_end_to_end_headers(client_head, upstream_head);
+    upstream_head.append("X-Forwarded-For: ");
+    upstream_head.append(conn.ip);
+    upstream_head.append("\r\nX-Forwarded-Proto: https\r\nConnection: keep-alive\r\n\r\n");
+
+    // A pooled connection may turn out closed only once the request is sent. Without a body the
+    // request is simply repeated on a new connection.
+    int fd = -1;
+    std::pmr::string response(&arena);
+    size_t response_head_end = std::string::npos;
+    int status = 0;
+    for (int attempt = 0; attempt < 2 && response_head_end == std::string::npos; attempt++) {
+        bool reused = false;
+        fd = acquire_upstream(upstream, reused, msg_queue_id);
+        if (fd == -1) return proxy_error(writer, "502 Bad Gateway");
+
+        bool ok = send_all(fd, upstream_head.data(), upstream_head.size()) &&
+                  (!has_body || forward_request_body(ssl, fd, body_start, chunked_request, request_length));
+        response.clear();
+        while (ok) {
+            response_head_end = response.find("\r\n\r\n");
+            if (response_head_end != std::string::npos) {
+                std::from_chars(response.data() + std::min<size_t>(9, response.size()),
+                                response.data() + response.size(), status);
+                if (status >= 200) break;
+                // Interim 1xx response, the final one follows
+                response.erase(0, response_head_end + 4);
+                response_head_end = std::string::npos;
+                continue;
+            }
+            const ssize_t n = response.size() > config().header_block_limit ? -1 : recv(fd, buffer, sizeof(buffer), 0);
+            if (n <= 0) {
+                ok = false;
+                break;
+            }
+            response.append(buffer, n);
+        }
+        if (!ok) {
+            close(fd);
+            response_head_end = std::string::npos;
+            if (!reused || has_body || !response.empty()) break;
+        }
+    }
+    if (response_head_end == std::string::npos) {
+        log_event("Proxy upstream failed: ", msg_queue_id, &conn, upstream.address);
+        return proxy_error(writer, "502 Bad Gateway");
+    }
+    response_head_end += 4;
+    const std::string_view upstream_response_head(response.data(), response_head_end);
+
+    // The client connection closes after this response, the upstream one stays open if possible
+    std::pmr::string client_response_head(&arena);
+    client_response_head.reserve(response_head_end + 32);
+    copy_end_to_end_headers(upstream_response_head, client_response_head);
+    client_response_head.append("Connection: close\r\n\r\n");
+    size_t bytes = client_response_head.size();
+    bool client_ok = writer.write(client_response_head.data(), client_response_head.size());
+
+    const bool no_body = method == "HEAD" || status == 204 || status == 304;
+    const bool chunked = contains_token(header_value(upstream_response_head, "Transfer-Encoding"), "chunked");
+    const std::string_view response_length_value = header_value(upstream_response_head, "Content-Length");
+    size_t remaining = 0;
+    const bool has_length = !response_length_value.empty() &&
+                            std::from_chars(response_length_value.data(),
+                                            response_length_value.data() + response_length_value.size(),
+                                            remaining).ec == std::errc();
+    bool reusable = !contains_token(header_value(upstream_response_head, "Connection"), "close") &&
+                    (no_body || chunked || has_length);
+
+    // Relay body bytes to the client, `data` starts with what arrived together with the headers
+    std::string_view data(response.data() + response_head_end, response.size() - response_head_end);
+    if (no_body && !data.empty()) reusable = false;
+    ChunkedTracker tracker;
+    bool complete = no_body;
+    while (!complete) {
+        size_t used = data.size();
+        if (chunked) {
+            used = tracker.feed(data.data(), data.size());
+            complete = tracker.done();
+        } else if (has_length) {
+            used = std::min(used, remaining);
+            remaining -= used;
+            complete = remaining == 0;
+        }
+        if (used < data.size()) reusable = false; // upstream sent more than the message
+        if (client_ok && used > 0) {
+            client_ok = writer.write(data.data(), used);
+            bytes += used;
+        }
+        if (complete || !client_ok) break;
 
-        char *args[] = {(char *) "/usr/bin/php-cgi", (char *) php_path.c_str(), nullptr};
-        execvp("/usr/bin/php-cgi", args);
-        perror("execvp");
-        exit(EXIT_FAILURE);
+        const ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0) break; // end of an until-close body, or the upstream failed mid-response
+        data = std::string_view(buffer, n);
+    }
+    if (reusable && complete && client_ok) {
+        release_upstream(upstream, fd);
     } else {
-        close(pipefd[1]);
-        std::string php_output;
-        const size_t buffer_size = 16384; // Increased buffer size
-        char buffer[buffer_size];
-        ssize_t n;
-        while ((n = read(pipefd[0], buffer, sizeof(buffer))) > 0) {
-            php_output.append(buffer, n);
-        }
-        close(pipefd[0]);
-        waitpid(pid, nullptr, 0);
+        close(fd);
+    }
+    return {status, bytes};
+}
 
-        if (!php_output.empty()) {
-            response = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nConnection: close\r\n\r\n";
-            response.append(php_output);
-        } else {
-            response = "HTTP/1.1 500 Internal Server Error\r\nContent-Type: text/html\r\nConnection: close\r\n\r\n";
+// Writes an upload to a temporary file in upload_dir and renames it into place once complete, so a
+// partial upload never shows up under its final name. The file is preallocated from Content-Length
+// and written in page-aligned upload_block_size blocks taken from the request arena.
+class UploadSink {
+public:
+    explicit UploadSink(RequestArena &arena)
+        : block_size_(config().upload_block_size),
+          block_(static_cast<char *>(arena.allocate(block_size_, 4096))) {
+    }
+
+    ~UploadSink() {
+        if (fd_ != -1) {
+            close(fd_);
+            unlink(temp_path_);
         }
     }
-}
 
-void handle_post_request(const std::string &body, const std::string &client_ip, int client_port, int msg_queue_id) {
-    std::istringstream body_stream(body);
-    std::string line;
-    std::string boundary;
+    UploadSink(const UploadSink &) = delete;
+    UploadSink &operator=(const UploadSink &) = delete;
+
+    bool open(const size_t expected_size) {
+        static std::atomic<uint64_t> upload_counter{0};
+        snprintf(temp_path_, sizeof(temp_path_), "%s/.upload-%d-%lu", config().upload_dir.c_str(), getpid(),
+                 static_cast<unsigned long>(upload_counter++));
+        const int flags = O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC;
+        direct_ = config().upload_direct_io;
+        fd_ = ::open(temp_path_, flags | (direct_ ? O_DIRECT : 0), 0644);
+        if (fd_ == -1 && direct_ && errno == EINVAL) {
+            direct_ = false; // filesystem without O_DIRECT support, e.g. tmpfs
+            fd_ = ::open(temp_path_, flags, 0644);
+        }
+        if (fd_ == -1) return false;
+        // Best effort, an upper bound since it includes the multipart framing; trimmed in commit()
+        if (expected_size > 0) fallocate(fd_, 0, 0, static_cast<off_t>(expected_size));
+        return true;
+    }
 
-    // Extract boundary from Content-Type header
-    while (std::getline(body_stream, line) && line != "\r") {
-        if (line.find("Content-Type: multipart/form-data; boundary=") != std::string::npos) {
-            boundary = line.substr(line.find("boundary=") + 9);
-            boundary.pop_back(); // Remove trailing \r
+    bool write(const char *data, size_t len) {
+        while (len > 0) {
+            const size_t n = std::min(len, block_size_ - fill_);
+            memcpy(block_ + fill_, data, n);
+            fill_ += n;
+            data += n;
+            len -= n;
+            if (fill_ == block_size_ && !flush_block()) return false;
         }
+        return true;
     }
 
-    if (boundary.empty()) {
-        log_event("Invalid POST request: Missing boundary", msg_queue_id, client_ip, client_port);
-        return;
+    bool commit(const char *final_path) {
+        // O_DIRECT needs whole blocks, the short tail goes through the page cache
+        if (fill_ > 0 && direct_) fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) & ~O_DIRECT);
+        if (fill_ > 0 && !flush_block()) return false;
+        if (ftruncate(fd_, static_cast<off_t>(size_)) == -1 || rename(temp_path_, final_path) == -1) return false;
+        close(fd_);
+        fd_ = -1;
+        return true;
     }
 
-    // Find the boundary in the body
-    size_t pos = body.find("--" + boundary);
-    if (pos == std::string::npos) {
-        log_event("Boundary not found in POST request", msg_queue_id, client_ip, client_port);
-        return;
+    size_t size() const {
+        return size_ + fill_;
     }
 
-    // Find the filename in the Content-Disposition header
-    pos = body.find("filename=\"", pos);
-    if (pos == std::string::npos) {
-        log_event("Filename not found in POST request", msg_queue_id, client_ip, client_port);
-        return;
+private:
+    bool flush_block() {
+        size_t done = 0;
+        while (done < fill_) {
+            const ssize_t n = pwrite(fd_, block_ + done, fill_ - done, static_cast<off_t>(size_ + done));
+            if (n <= 0) return false;
+            done += n;
+        }
+        size_ += fill_;
+        fill_ = 0;
+        return true;
     }
 
-    size_t filename_start = pos + 10; // "filename=\"" is 10 characters
-    size_t filename_end = body.find('\"', filename_start);
-    std::string filename = body.substr(filename_start, filename_end - filename_start);
+    const size_t block_size_; // fixed for the upload, a reload may change the setting meanwhile
+    char *block_;
+    size_t fill_ = 0;
+    size_t size_ = 0;
+    int fd_ = -1;
+    bool direct_ = false;
+    char temp_path_[256]{};
+};
 
-    // Find the start of the file content
-    pos = body.find("\r\n\r\n", filename_end);
-    if (pos == std::string::npos) {
-        log_event("File content not found in POST request", msg_queue_id, client_ip, client_port);
-        return;
+// Read the body of a request, never more than Content-Length. Returns 0 at its end or on error.
+int read_body(SSL *ssl, char *buffer, const size_t size, size_t &remaining) {
+    if (remaining == 0) return 0;
+    const int n = SSL_read(ssl, buffer, static_cast<int>(std::min(size, remaining)));
+    if (n <= 0) return 0;
+    remaining -= n;
+    return n;
+}
+
+// Store the first file of a multipart/form-data upload. The file data is streamed from the TLS
+// connection to an UploadSink as it arrives, holding back only enough bytes to spot the closing
+// boundary. Sets the response and returns its status.
+int handle_upload(ClientConnection &conn, const std::string_view request, const int msg_queue_id,
+                  RequestArena &arena, std::pmr::string &response) {
+    TraceSpan span("handle_upload");
+    SSL *ssl = conn.ssl;
+    const int64_t start_ns = monotonic_ns();
+    response = "HTTP/1.1 400 Bad Request\r\nContent-Type: text/html\r\nConnection: close\r\n\r\nInvalid upload.";
+
+    std::pmr::string head(&arena);
+    size_t head_end;
+    if (!read_request_head(ssl, request, head, head_end)) {
+        log_event("Invalid POST request: Incomplete headers", msg_queue_id, &conn);
+        return 400;
     }
+    const std::string_view headers(head.data(), head_end);
+    const std::string_view length_value = header_value(headers, "Content-Length");
+    size_t content_length = 0;
+    std::from_chars(length_value.data(), length_value.data() + length_value.size(), content_length);
+    const std::string_view content_type = header_value(headers, "Content-Type");
+    const size_t boundary_pos = content_type.find("boundary=");
+    if (boundary_pos == std::string_view::npos) {
+        log_event("Invalid POST request: Missing boundary", msg_queue_id, &conn);
+        return 400;
+    }
+    std::string_view boundary = content_type.substr(boundary_pos + 9);
+    boundary = boundary.substr(0, boundary.find(';'));
+    if (boundary.size() > 1 && boundary.front() == '"') boundary = boundary.substr(1, boundary.size() - 2);
 
-    size_t file_content_start = pos + 4; // Skip "\r\n\r\n"
-    size_t file_content_end = body.find("--" + boundary, file_content_start);
-    std::string file_content = body.substr(file_content_start, file_content_end - file_content_start);
+    size_t remaining = content_length - std::min(content_length, head.size() - head_end);
+    char buffer[16384];
 
-    std::string file_path = std::string(UPLOAD_DIR) + "/" + filename;
-    std::cout << "Saving file to: " << file_path << std::endl;
+    // Clients holding large bodies back for confirmation would otherwise wait out their own timeout
+    if (remaining > 0 && contains_token(header_value(headers, "Expect"), "100-continue")) {
+        constexpr std::string_view interim = "HTTP/1.1 100 Continue\r\n\r\n";
+        conn.writer.write(interim.data(), interim.size());
+    }
 
-    // Save the file
-    std::ofstream out_file(file_path, std::ios::binary);
-    if (!out_file) {
-        log_event("Failed to create file on server: " + file_path, msg_queue_id, client_ip, client_port);
-        return;
+    // Collect the preamble and the file part's headers
+    std::pmr::string pending(std::string_view(head).substr(head_end, content_length), &arena); // no heap temporary
+    const std::pmr::string opening = arena_concat(arena, {"--", boundary});
+    size_t part_headers_end;
+    size_t filename_pos;
+    while ((filename_pos = pending.find("filename=\"", pending.find(opening))) == std::string::npos ||
+           (part_headers_end = pending.find("\r\n\r\n", filename_pos)) == std::string::npos) {
+        const int n = pending.size() > config().header_block_limit ? 0
+                                                                   : read_body(ssl, buffer, sizeof(buffer), remaining);
+        if (n == 0) {
+            log_event("Filename not found in POST request", msg_queue_id, &conn);
+            return 400;
+        }
+        pending.append(buffer, n);
+    }
+
+    // Only the last path component of the client's file name is used
+    const size_t filename_end = pending.find('"', filename_pos + 10);
+    std::string_view filename;
+    if (filename_end < part_headers_end) {
+        filename = std::string_view(pending).substr(filename_pos + 10, filename_end - filename_pos - 10);
+        filename = filename.substr(filename.find_last_of("/\\") + 1);
+    }
+    if (filename.empty() || filename == "." || filename == "..") {
+        log_event("Invalid POST request: Bad file name", msg_queue_id, &conn);
+        return 400;
+    }
+    const std::pmr::string file_path = arena_concat(arena, {config().upload_dir, "/", filename});
+    filename = std::string_view(file_path).substr(file_path.size() - filename.size());
+    pending.erase(0, part_headers_end + 4);
+
+    UploadSink sink(arena);
+    response = "HTTP/1.1 500 Internal Server Error\r\nContent-Type: text/html\r\nConnection: close\r\n\r\nUpload failed.";
+    if (!sink.open(content_length)) {
+        log_event("Failed to create file on server: ", msg_queue_id, &conn, file_path);
+        return 500;
+    }
+
+    // Stream the file data, keeping back a possible partial delimiter at the end of each read
+    const std::pmr::string delimiter = arena_concat(arena, {"\r\n--", boundary});
+    pending.reserve(sizeof(buffer) + delimiter.size());
+    size_t delimiter_pos;
+    while ((delimiter_pos = pending.find(delimiter)) == std::string::npos) {
+        const size_t keep = std::min(pending.size(), delimiter.size() - 1);
+        if (!sink.write(pending.data(), pending.size() - keep)) {
+            log_event("Failed to write uploaded file: ", msg_queue_id, &conn, file_path);
+            return 500;
+        }
+        pending.erase(0, pending.size() - keep);
+        const int n = read_body(ssl, buffer, sizeof(buffer), remaining);
+        if (n == 0) {
+            log_event("File content not found in POST request", msg_queue_id, &conn);
+            response = "HTTP/1.1 400 Bad Request\r\nContent-Type: text/html\r\nConnection: close\r\n\r\nInvalid upload.";
+            return 400;
+        }
+        pending.append(buffer, n);
+    }
+    if (!sink.write(pending.data(), delimiter_pos) || !sink.commit(file_path.c_str())) {
+        log_event("Failed to write uploaded file: ", msg_queue_id, &conn, file_path);
+        return 500;
     }
 
-    out_file.write(file_content.c_str(), file_content.size());
-    out_file.close();
+    // Drain the closing boundary so closing the connection does not reset it before the response
+    while (read_body(ssl, buffer, sizeof(buffer), remaining) > 0) {
+    }
 
-    log_event("File uploaded: " + filename, msg_queue_id, client_ip, client_port);
+    const double seconds = std::max(monotonic_ns() - start_ns, int64_t{1}) / 1e9;
+    char detail[320];
+    snprintf(detail, sizeof(detail), "%.*s, %zu bytes in %.1f ms (%.1f MB/s)", static_cast<int>(filename.size()),
+             filename.data(), sink.size(), seconds * 1000, sink.size() / seconds / 1e6);
+    log_event("File uploaded: ", msg_queue_id, &conn, detail);
+    response = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nConnection: close\r\n\r\nFile uploaded successfully.";
+    return 200;
 }
 
-void handle_client(SSL *ssl, const int msg_queue_id, const std::string &client_ip, const int client_port) {
-    char buffer[1024] = {0};
-    const int bytes = SSL_read(ssl, buffer, sizeof(buffer));
+void handle_client(ClientConnection &conn, const int msg_queue_id, RequestArena &arena) {
+    TraceSpan span("handle_client");
+    SSL *ssl = conn.ssl;
+
+    // Early data was read during the handshake and must fit in full
+    const size_t buffer_size = std::max<size_t>(config().request_buffer_size, conn.early_data_len);
+    char *buffer = static_cast<char *>(arena.allocate(buffer_size, 1));
+    int bytes;
+    if (conn.early_data_len > 0) {
+        memcpy(buffer, conn.early_data, conn.early_data_len);
+        bytes = static_cast<int>(conn.early_data_len);
+    } else {
+        TraceSpan read_span("ssl_read");
+        bytes = SSL_read(ssl, buffer, static_cast<int>(buffer_size));
+    }
 
     if (bytes <= 0) {
         const int err = SSL_get_error(ssl, bytes);
         if (err == SSL_ERROR_ZERO_RETURN) {
-            log_event("Client closed the connection gracefully", msg_queue_id, client_ip, client_port);
+            log_event("Client closed the connection gracefully", msg_queue_id, &conn);
         } else if (err == SSL_ERROR_SYSCALL || err == SSL_ERROR_SSL) {
-            log_event("Client disconnected abruptly or SSL error", msg_queue_id, client_ip, client_port);
+            log_event("Client disconnected abruptly or SSL error", msg_queue_id, &conn);
             ERR_print_errors_fp(stderr);
         } else {
-            log_event("SSL read error", msg_queue_id, client_ip, client_port);
+            log_event("SSL read error", msg_queue_id, &conn);
             ERR_print_errors_fp(stderr);
         }
         SSL_shutdown(ssl);
@@ -238,83 +2088,131 @@ void handle_client(SSL *ssl, const int msg_queue_id, const std::string &client_i
         return;
     }
 
-    const std::string request(buffer, bytes);
+    const std::string_view request(buffer, bytes);
+    const std::string_view method = request.substr(0, request.find(' '));
+    const std::string_view path = parse_http_request(request);
+    const std::string_view request_line =
+        path.empty() ? method : request.substr(0, path.data() + path.size() - request.data());
+    const bool early_data_rejected =
+        conn.early_data_len > 0 && (conn.early_data_truncated || !is_early_data_safe(method, path, request));
+
+    // Proxied paths stream the request body to the upstream instead of buffering it here
+    ProxyUpstream *upstream = early_data_rejected ? nullptr : find_proxy_upstream(path);
+    if (upstream) {
+        const ProxyResult result = handle_proxy_request(conn, request, *upstream, msg_queue_id, arena);
+        if (conn.early_data_len > 0) {
+            server_metrics->early_data_accepted++;
+        }
+        log_access(conn, result.status, result.bytes, request_line, msg_queue_id);
+        SSL_shutdown(ssl);
+        SSL_free(ssl);
+        return;
+    }
 
     // Extract Content-Length from the request headers
     size_t content_length = 0;
     const size_t content_length_pos = request.find("Content-Length: ");
-    if (content_length_pos != std::string::npos) {
-        const size_t content_length_end = request.find("\r\n", content_length_pos);
-        const std::string content_length_str = request.substr(content_length_pos + 16,
-                                                              content_length_end - (content_length_pos + 16));
-        content_length = std::stoul(content_length_str);
-    }
-
-    // Read the remaining request body if Content-Length is larger than the initial buffer
-    std::string body;
-    if (content_length > 0) {
-        body = request;
-        while (body.size() < content_length) {
-            char additional_buffer[1024] = {0};
-            const int additional_bytes = SSL_read(ssl, additional_buffer, sizeof(additional_buffer));
-            if (additional_bytes <= 0) {
-                log_event("Failed to read request body", msg_queue_id, client_ip, client_port);
-                SSL_shutdown(ssl);
-                SSL_free(ssl);
-                return;
-            }
-            body.append(additional_buffer, additional_bytes);
+    if (content_length_pos != std::string_view::npos) {
+        const char *digits = request.data() + content_length_pos + 16;
+        std::from_chars(digits, request.data() + request.size(), content_length);
+    }
+
+    // Only uploads use a request body and stream it themselves, any other body is read and discarded
+    // The body of a rejected early request was early data and has been discarded with the rest of it
+    const bool upload = method == "POST" && path == "/upload" && !early_data_rejected;
+    if (content_length > 0 && !upload && !early_data_rejected) {
+        TraceSpan body_span("read_body");
+        const size_t head_end = request.find("\r\n\r\n");
+        size_t remaining = content_length - std::min(content_length, head_end == std::string_view::npos
+                                                                         ? 0 : request.size() - head_end - 4);
+        char discard[4096];
+        while (read_body(ssl, discard, sizeof(discard), remaining) > 0) {
+        }
+        if (remaining > 0) {
+            log_event("Failed to read request body", msg_queue_id, &conn);
+            SSL_shutdown(ssl);
+            SSL_free(ssl);
+            return;
         }
     }
 
     // Handle the request
-    const std::string method = request.substr(0, request.find(' '));
-    const std::string path = parse_http_request(request);
-
-    std::string response;
-    if (method == "POST" && path == "/upload") {
-        handle_post_request(body, client_ip, client_port, msg_queue_id);
-        response = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nConnection: close\r\n\r\nFile uploaded successfully.";
+    std::pmr::string response(&arena);
+    if (early_data_rejected) {
+        // Unsafe request in replayable 0-RTT data, the client retries it after the handshake (RFC 8470)
+        server_metrics->early_data_rejected++;
+        log_event("Rejected early data request: ", msg_queue_id, &conn, request_line);
+        response = "HTTP/1.1 425 Too Early\r\nContent-Type: text/html\r\nConnection: close\r\n\r\n";
+    } else if (path == config().status_path) {
+        render_server_status(response);
+    } else if (upload) {
+        handle_upload(conn, request, msg_queue_id, arena, response);
     } else {
-        std::string file_path = "www" + path;
+        std::pmr::string file_path = arena_concat(arena, {"www", path});
         if (file_path == "www/") {
-            file_path = INDEX_PATH;
+            file_path = config().index_path;
         }
 
         // Check if the file exists
-        if (!std::filesystem::exists(file_path)) {
-            const std::string content = read_file(FILE_NOT_FOUND_PATH);
-            response = "HTTP/1.1 404 Not Found\r\nContent-Type: text/html\r\nConnection: close\r\n\r\n" + content;
+        struct stat file_stat{};
+        if (stat(file_path.c_str(), &file_stat) == -1) {
+            response = "HTTP/1.1 404 Not Found\r\nContent-Type: text/html\r\nConnection: close\r\n\r\n";
+            read_file(config().file_not_found_path.c_str(), response);
         }
         // Handle PHP files
         else if (file_path.find(".php") != std::string::npos) {
-            handle_php_request(file_path, response);
+            handle_php_request(file_path, response, arena);
         }
-        // Serve static files
+        // Serve static files, read directly behind the headers
         else {
-            const std::string content = read_file(file_path);
-            if (!content.empty()) {
-                const std::string content_type = get_content_type(file_path);
-                response = "HTTP/1.1 200 OK\r\nContent-Type: " + content_type +
-                           "\r\nConnection: close\r\n\r\n" + content;
-            } else {
-                std::string content = read_file(FILE_NOT_FOUND_PATH);
-                response = "HTTP/1.1 404 Not Found\r\nContent-Type: text/html\r\nConnection: close\r\n\r\n" + content;
+            response.reserve(128 + file_stat.st_size);
+            response = "HTTP/1.1 200 OK\r\nContent-Type: ";
+            response += get_content_type(file_path);
+            response += "\r\nConnection: close\r\n\r\n";
+            const size_t header_size = response.size();
+            if (!read_file(file_path.c_str(), response) || response.size() == header_size) {
+                response = "HTTP/1.1 404 Not Found\r\nContent-Type: text/html\r\nConnection: close\r\n\r\n";
+                read_file(config().file_not_found_path.c_str(), response);
             }
         }
     }
 
-    if (SSL_write(ssl, response.c_str(), response.length()) <= 0) {
-        log_event("SSL write error", msg_queue_id, client_ip, client_port);
+    if (conn.early_data_len > 0 && response.compare(9, 3, "425") != 0) {
+        server_metrics->early_data_accepted++;
+    }
+
+    TraceSpan write_span("ssl_write");
+    if (!conn.writer.write(response.data(), response.size())) {
+        log_event("SSL write error", msg_queue_id, &conn);
+        ERR_print_errors_fp(stderr);
+    }
+    if (conn.early_response && !(drain_early_data(ssl) && SSL_accept(ssl) > 0)) {
+        log_event("SSL handshake failed after the early response", msg_queue_id, &conn);
         ERR_print_errors_fp(stderr);
     }
 
-    log_event("Worker handled SSL client", msg_queue_id, client_ip, client_port);
+    int status = 0;
+    std::from_chars(response.data() + 9, response.data() + std::min<size_t>(response.size(), 12), status);
+    log_access(conn, status, response.size(), request_line, msg_queue_id);
 
     SSL_shutdown(ssl);
     SSL_free(ssl);
 }
 
+// Handle one connection with the thread's arena and account for any heap allocation it needed
+void serve_connection(ClientConnection &conn, const int msg_queue_id, RequestArena &arena) {
+    const uint64_t allocations_before = heap_allocations;
+    handle_client(conn, msg_queue_id, arena);
+    arena.reset();
+
+    const uint64_t allocations = heap_allocations - allocations_before;
+    server_metrics->arena_requests++;
+    if (allocations > 0) {
+        server_metrics->request_heap_allocations += allocations;
+        server_metrics->requests_with_heap_allocations++;
+    }
+}
+
 void load_certificates(SSL_CTX *ctx, const std::string &cert_file, const std::string &key_file) {
     if (SSL_CTX_use_certificate_file(ctx, cert_file.c_str(), SSL_FILETYPE_PEM) <= 0) {
         ERR_print_errors_fp(stderr);
@@ -330,101 +2228,547 @@ void load_certificates(SSL_CTX *ctx, const std::string &cert_file, const std::st
     }
 }
 
-void worker_process(const int sock_fd, const int msg_queue_id, SSL_CTX *ctx) {
-    while (true) {
-        int client_fd;
-        struct msghdr msg = {};
-        char buf[CMSG_SPACE(sizeof(int))];
-        struct iovec io = {.iov_base = &client_fd, .iov_len = sizeof(client_fd)};
-        msg.msg_iov = &io;
-        msg.msg_iovlen = 1;
-        msg.msg_control = buf;
-        msg.msg_controllen = sizeof(buf);
-        if (recvmsg(sock_fd, &msg, 0) == -1) {
+// Receive a client socket passed by the master over the worker's socketpair
+bool receive_client_fd(const int sock_fd, int &client_fd) {
+    struct msghdr msg = {};
+    char buf[CMSG_SPACE(sizeof(int))];
+    struct iovec io = {.iov_base = &client_fd, .iov_len = sizeof(client_fd)};
+    msg.msg_iov = &io;
+    msg.msg_iovlen = 1;
+    msg.msg_control = buf;
+    msg.msg_controllen = sizeof(buf);
+    if (recvmsg(sock_fd, &msg, 0) == -1) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
             perror("recvmsg");
-            continue;
         }
-        const struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        return false;
+    }
+    const struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+
+    if (cmsg && cmsg->cmsg_len == CMSG_LEN(sizeof(int)) && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type ==
+        SCM_RIGHTS) {
+        memcpy(&client_fd, CMSG_DATA(cmsg), sizeof(client_fd));
+        return true;
+    }
+    return false;
+}
+
+// Claim the ticket's fingerprint in the shared anti-replay table, fails if it was used within the window
+bool claim_early_data_ticket(const uint64_t fingerprint) {
+    const int64_t now = std::time(nullptr);
+    const size_t start = fingerprint & (EARLY_DATA_REPLAY_SLOTS - 1);
+    for (size_t probe = 0; probe < 8; probe++) {
+        const size_t slot = (start + probe) & (EARLY_DATA_REPLAY_SLOTS - 1);
+        uint64_t current = replay_cache->fingerprint[slot].load();
+        if (current == fingerprint && replay_cache->expires[slot].load() > now) {
+            return false;
+        }
+        if ((current == 0 || replay_cache->expires[slot].load() <= now) &&
+            replay_cache->fingerprint[slot].compare_exchange_strong(current, fingerprint)) {
+            replay_cache->expires[slot].store(now + config().tls_ticket_lifetime);
+            return true;
+        }
+    }
+    return false; // table saturated, fall back to a full round trip rather than risk a replay
+}
+
+// OpenSSL callback deciding whether a resumed session may send early data
+int allow_early_data(SSL *ssl, void *) {
+    unsigned int id_len = 0;
+    const unsigned char *id = SSL_SESSION_get_id(SSL_get_session(ssl), &id_len);
+    uint64_t fingerprint = 1469598103934665603ULL; // FNV-1a over the per-ticket session id
+    for (unsigned int i = 0; i < id_len; i++) {
+        fingerprint = (fingerprint ^ id[i]) * 1099511628211ULL;
+    }
+    if (id_len == 0 || !claim_early_data_ticket(fingerprint | 1)) {
+        server_metrics->early_data_replayed++;
+        return 0;
+    }
+    return 1;
+}
+
+// Read TLS 1.3 early data before the handshake completes, leaves early_data_len at 0 when none was accepted.
+// Reading stops as soon as the header block is in: a request that is safe to answer from early data is
+// answered straight away (early_response), before the client's Finished arrives, and the handshake
+// completes after the response. Any other request waits for the handshake and the rest of its early data
+// is discarded, so is the tail of early data that does not fit the buffer, and such requests get a 425.
+bool read_early_data(ClientConnection &conn) {
+    if (!config().tls_early_data) {
+        return true;
+    }
+    while (true) {
+        if (conn.early_data_len == sizeof(conn.early_data)) {
+            conn.early_data_truncated = true;
+            return drain_early_data(conn.ssl);
+        }
+        size_t read_bytes = 0;
+        const int status = SSL_read_early_data(conn.ssl, conn.early_data + conn.early_data_len,
+                                               sizeof(conn.early_data) - conn.early_data_len, &read_bytes);
+        conn.early_data_len += read_bytes;
+        if (status == SSL_READ_EARLY_DATA_ERROR) {
+            return false;
+        }
+        if (status == SSL_READ_EARLY_DATA_FINISH) {
+            break;
+        }
+        const std::string_view request(conn.early_data, conn.early_data_len);
+        if (request.find("\r\n\r\n") != std::string_view::npos) {
+            const std::string_view path = parse_http_request(request);
+            if (is_early_data_safe(request.substr(0, request.find(' ')), path, request) &&
+                !find_proxy_upstream(path)) {
+                conn.early_response = true;
+                return true;
+            }
+            return drain_early_data(conn.ssl);
+        }
+    }
+    if (SSL_get_early_data_status(conn.ssl) != SSL_EARLY_DATA_ACCEPTED) {
+        conn.early_data_len = 0;
+    }
+    return true;
+}
+
+// Run the TLS handshake for a received client socket, closing it on failure
+bool accept_client(ClientConnection &conn, const int msg_queue_id, SSL_CTX *ctx) {
+    struct sockaddr_in client_addr{};
+    socklen_t addrlen = sizeof(client_addr);
+    getpeername(conn.fd, (sockaddr *) &client_addr, &addrlen);
+
+    inet_ntop(AF_INET, &(client_addr.sin_addr), conn.ip, INET_ADDRSTRLEN);
+    conn.addr = client_addr.sin_addr.s_addr;
+    conn.port = ntohs(client_addr.sin_port);
+    conn.accepted_ns = monotonic_ns();
+
+    log_event("Worker handling connection", msg_queue_id, &conn);
+
+    conn.ssl = SSL_new(ctx);
+    SSL_set_fd(conn.ssl, conn.fd);
+    conn.writer = TlsRecordWriter(conn.ssl);
+    conn.early_data_len = 0;
+    conn.early_data_truncated = false;
+    conn.early_response = false;
+
+    bool handshake_done;
+    {
+        TraceSpan span("tls_handshake");
+        handshake_done = read_early_data(conn) && (conn.early_response || SSL_accept(conn.ssl) > 0);
+    }
+    if (!handshake_done) {
+        char err_buf[256];
+        ERR_error_string_n(ERR_get_error(), err_buf, sizeof(err_buf));
+        log_event("SSL handshake failed: ", msg_queue_id, &conn, err_buf);
+        ERR_print_errors_fp(stderr);
+        SSL_shutdown(conn.ssl);
+        SSL_free(conn.ssl);
+        close(conn.fd);
+        return false;
+    }
+    return true;
+}
+
+// Number of handshake threads per worker, handshake_threads = -1 spreads the online cores across workers
+int handshake_thread_count() {
+    if (config().handshake_threads >= 0) {
+        return std::min(config().handshake_threads, WORKER_THREAD_SLOTS - config().request_threads);
+    }
+    const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return static_cast<int>(std::clamp(cores / config().workers, 1L,
+                                       static_cast<long>(WORKER_THREAD_SLOTS - config().request_threads)));
+}
+
+// Connections a worker accepts at once before the master treats it as busy
+int worker_capacity() {
+    return (handshake_thread_count() == 0 ? 1 : config().request_threads) + config().worker_backlog;
+}
+
+// Publishes in the worker table that a worker thread is occupied by a connection
+class BusyGuard {
+public:
+    BusyGuard(WorkerSlot &slot, const int thread) : since_(slot.busy_since_ns[thread]) {
+        since_.store(monotonic_ns());
+    }
+
+    ~BusyGuard() {
+        since_.store(0);
+    }
+
+private:
+    std::atomic<int64_t> &since_;
+};
+
+// Periodic duties of a worker's dispatch loop: heartbeat, trace dumps, profiler control, configuration
+// reloads and upstream health checks
+// Wake up from recvmsg regularly so an idle worker keeps its heartbeat fresh
+void apply_heartbeat_interval(const int sock_fd) {
+    timeval heartbeat_interval{};
+    heartbeat_interval.tv_sec = config().worker_heartbeat_ms / 1000;
+    heartbeat_interval.tv_usec = (config().worker_heartbeat_ms % 1000) * 1000;
+    setsockopt(sock_fd, SOL_SOCKET, SO_RCVTIMEO, &heartbeat_interval, sizeof(heartbeat_interval));
+}
+
+void worker_housekeeping(WorkerSlot &slot, const int worker, const int sock_fd, const int msg_queue_id) {
+    static int64_t last_profile_flush = monotonic_ns();
+    const int64_t now = monotonic_ns();
+    slot.heartbeat_ns.store(now);
+
+    if (trace_dump_requested) {
+        trace_dump_requested = 0;
+        dump_trace(worker);
+    }
+    if (profiler_toggle_requested) {
+        profiler_toggle_requested = 0;
+        if (profiler_running) {
+            profiler_running = false;
+            flush_profile();
+        } else {
+            start_profiler();
+        }
+        std::cerr << "Worker " << worker << " profiler " << (profiler_running ? "started" : "stopped") << std::endl;
+    }
+    if (profiler_running && (now - last_profile_flush >= config().profiler_flush_ms * 1000000LL ||
+                             profile_next.load() >= PROFILER_MAX_SAMPLES * 3 / 4)) {
+        flush_profile();
+        last_profile_flush = now;
+    }
+    if (reload_requested) {
+        reload_requested = 0;
+        reload_config(msg_queue_id, false);
+        apply_heartbeat_interval(sock_fd);
+    }
+    check_proxy_upstreams(msg_queue_id);
+}
 
-        if (cmsg && cmsg->cmsg_len == CMSG_LEN(sizeof(int)) && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type ==
-            SCM_RIGHTS) {
-            memcpy(&client_fd, CMSG_DATA(cmsg), sizeof(client_fd));
+void finish_connection(WorkerSlot &slot) {
+    slot.requests_served++;
+    slot.in_flight--;
+}
 
-            struct sockaddr_in client_addr{};
-            socklen_t addrlen = sizeof(client_addr);
-            getpeername(client_fd, (sockaddr *) &client_addr, &addrlen);
+void worker_process(const int worker, const int sock_fd, const int msg_queue_id, SSL_CTX *ctx) {
+    WorkerSlot &slot = worker_slots[worker];
+    const int handshake_threads = handshake_thread_count();
+    current_worker = worker;
 
-            char client_ip[INET_ADDRSTRLEN];
-            inet_ntop(AF_INET, &(client_addr.sin_addr), client_ip, INET_ADDRSTRLEN);
-            const int client_port = ntohs(client_addr.sin_port);
+    // The master's SIGCHLD reaper must not run for the worker's own php-cgi children
+    signal(SIGCHLD, SIG_DFL);
 
-            log_event("Worker handling connection", msg_queue_id, client_ip, client_port);
+    apply_heartbeat_interval(sock_fd);
 
-            SSL *ssl = SSL_new(ctx);
-            SSL_set_fd(ssl, client_fd);
+    if (config().profiler_enabled) {
+        start_profiler();
+    }
 
-            if (SSL_accept(ssl) <= 0) {
-                log_event("SSL handshake failed: " + std::string(ERR_error_string(ERR_get_error(), nullptr)),
-                          msg_queue_id, client_ip, client_port);
-                ERR_print_errors_fp(stderr);
-                SSL_shutdown(ssl);
-                SSL_free(ssl);
-                close(client_fd);
+    // Inline mode: handshake and request handling on the worker's only thread
+    if (handshake_threads == 0) {
+        RequestArena arena(config().request_arena_size);
+        while (true) {
+            worker_housekeeping(slot, worker, sock_fd, msg_queue_id);
+            ClientConnection conn{};
+            if (!receive_client_fd(sock_fd, conn.fd)) {
                 continue;
             }
+            {
+                TraceSpan span("connection");
+                BusyGuard busy(slot, 0);
+                if (accept_client(conn, msg_queue_id, ctx)) {
+                    serve_connection(conn, msg_queue_id, arena);
+                    close(conn.fd);
+                }
+            }
+            finish_connection(slot);
+        }
+    }
+
+    // Pipelined mode: handshake threads complete TLS sessions and hand them to request threads,
+    // so a burst of full handshakes does not stall requests on already established sessions
+    WorkQueue<int> accepted_fds;
+    WorkQueue<ClientConnection> established;
+    std::vector<std::thread> threads;
+
+    for (int i = 0; i < handshake_threads; i++) {
+        threads.emplace_back([&, i] {
+            while (true) {
+                ClientConnection conn{};
+                conn.fd = accepted_fds.pop();
+                BusyGuard busy(slot, config().request_threads + i);
+                if (accept_client(conn, msg_queue_id, ctx)) {
+                    established.push(conn);
+                } else {
+                    finish_connection(slot);
+                }
+            }
+        });
+    }
+    for (int i = 0; i < config().request_threads; i++) {
+        threads.emplace_back([&, i] {
+            RequestArena arena(config().request_arena_size);
+            while (true) {
+                ClientConnection conn = established.pop();
+                {
+                    TraceSpan span("connection");
+                    BusyGuard busy(slot, i);
+                    serve_connection(conn, msg_queue_id, arena);
+                    close(conn.fd);
+                }
+                finish_connection(slot);
+            }
+        });
+    }
+
+    while (true) {
+        worker_housekeeping(slot, worker, sock_fd, msg_queue_id);
+        int client_fd;
+        if (receive_client_fd(sock_fd, client_fd)) {
+            accepted_fds.push(client_fd);
+        }
+    }
+}
+
+volatile sig_atomic_t children_exited = 0;
+
+void handle_sigchld(int) {
+    children_exited = 1;
+}
+
+// Fork worker process `worker` with a fresh socketpair and reset its slot in the worker table
+void spawn_worker(const int worker, std::vector<std::array<int, 2>> &worker_sockets, const int msg_queue_id,
+                  SSL_CTX *ctx) {
+    WorkerSlot &slot = worker_slots[worker];
+    // Retried from the master loop, a failure here would otherwise leave the slot empty for good
+    slot.respawn_ns.store(monotonic_ns() + config().worker_heartbeat_ms * 1000000LL);
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, worker_sockets[worker].data()) == -1) {
+        perror("socketpair");
+        return;
+    }
+    slot.heartbeat_ns.store(monotonic_ns());
+    slot.in_flight.store(0);
+    for (auto &since: slot.busy_since_ns) since.store(0);
+
+    const pid_t pid = fork();
+    if (pid == 0) {
+        place_worker(worker);
+        close(worker_sockets[worker][1]); // Close the parent's end
+        worker_process(worker, worker_sockets[worker][0], msg_queue_id, ctx);
+        exit(0);
+    }
+    close(worker_sockets[worker][0]); // Close the child's end
+    if (pid == -1) {
+        perror("fork");
+        close(worker_sockets[worker][1]);
+        return;
+    }
+    slot.pid.store(pid);
+    slot.respawn_ns.store(0);
+}
+
+// Start again the workers whose spawn failed, e.g. because fork hit a process or memory limit
+void respawn_failed_workers(std::vector<std::array<int, 2>> &worker_sockets, const int msg_queue_id,
+                            SSL_CTX *ctx) {
+    const int64_t now = monotonic_ns();
+    for (int i = 0; i < config().workers; i++) {
+        const int64_t due = worker_slots[i].respawn_ns.load();
+        if (worker_slots[i].pid.load() > 0 || due == 0 || now < due) continue;
+        log_event("Retrying to start worker.", msg_queue_id, nullptr, {}, i);
+        spawn_worker(i, worker_sockets, msg_queue_id, ctx);
+    }
+}
+
+// Kill workers that stopped sending heartbeats while idle or hold a connection past the deadline.
+// Their exit is picked up by reap_children(), which starts a replacement.
+void check_worker_health(const int msg_queue_id) {
+    const int64_t now = monotonic_ns();
+    for (int i = 0; i < config().workers; i++) {
+        WorkerSlot &slot = worker_slots[i];
+        const pid_t pid = slot.pid.load();
+        if (pid <= 0) continue;
+
+        bool busy = false;
+        bool overdue = false;
+        for (const auto &since: slot.busy_since_ns) {
+            const int64_t start = since.load();
+            if (start == 0) continue;
+            busy = true;
+            overdue |= now - start > config().request_deadline_ms * 1000000LL;
+        }
+        const bool stalled = !busy && now - slot.heartbeat_ns.load() > config().worker_stall_timeout_ms * 1000000LL;
+        if (overdue || stalled) {
+            log_event(overdue ? "Worker exceeded the request deadline, killing it." : "Worker stopped responding, killing it.",
+                      msg_queue_id, nullptr, {}, i);
+            kill(pid, SIGKILL);
+        }
+    }
+}
 
-            handle_client(ssl, msg_queue_id, client_ip, client_port);
-            close(client_fd);
+// Collect exited children and restart them
+void reap_children(pid_t &logger_pid, std::vector<std::array<int, 2>> &worker_sockets, const int msg_queue_id,
+                   SSL_CTX *ctx) {
+    children_exited = 0;
+    pid_t pid;
+    while ((pid = waitpid(-1, nullptr, WNOHANG)) > 0) {
+        if (pid == logger_pid) {
+            std::cerr << "Logger process exited, restarting." << std::endl;
+            if ((logger_pid = fork()) == 0) {
+                logger_process();
+                exit(0);
+            }
+            continue;
+        }
+        for (int i = 0; i < config().workers; i++) {
+            if (worker_slots[i].pid.load() != pid) continue;
+            log_event("Worker is no longer alive, restarting.", msg_queue_id, nullptr, {}, i);
+            worker_slots[i].pid.store(0);
+            close(worker_sockets[i][1]);
+            spawn_worker(i, worker_sockets, msg_queue_id, ctx);
         }
     }
 }
 
-int main() {
+void signal_workers(const int sig) {
+    for (int i = 0; i < config().workers; i++) {
+        const pid_t pid = worker_slots[i].pid.load();
+        if (pid > 0) kill(pid, sig);
+    }
+}
+
+// Pass a client socket to a worker over its socketpair
+bool send_client_fd(const int worker_socket, int client_socket) {
+    struct msghdr msg = {};
+    char buf[CMSG_SPACE(sizeof(int))];
+    struct iovec io = {.iov_base = &client_socket, .iov_len = sizeof(client_socket)};
+    msg.msg_iov = &io;
+    msg.msg_iovlen = 1;
+    msg.msg_control = buf;
+    msg.msg_controllen = sizeof(buf);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    memcpy(CMSG_DATA(cmsg), &client_socket, sizeof(client_socket));
+
+    if (sendmsg(worker_socket, &msg, 0) == -1) {
+        perror("sendmsg");
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
     // Ignore SIGPIPE to prevent crashes on writes to closed sockets
     signal(SIGPIPE, SIG_IGN);
 
+    // Without a configuration file the built-in defaults apply, unless a file was named explicitly
+    if (argc > 1) config_path = argv[1];
+    auto startup_config = std::make_unique<ServerConfig>();
+    std::string config_error;
+    if (parse_config(config_path, *startup_config, config_error)) {
+        current_config.store(startup_config.release());
+    } else if (argc > 1 || std::filesystem::exists(config_path)) {
+        std::cerr << "Invalid configuration, " << config_error << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
     // Initialize OpenSSL
     SSL_library_init();
     SSL_load_error_strings();
     OpenSSL_add_all_algorithms();
     SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
-    SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
     SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
-    load_certificates(ctx, "certificates/server.crt", "certificates/server.key");
+    SSL_CTX_sess_set_cache_size(ctx, config().tls_session_cache_size);
+    SSL_CTX_set_min_proto_version(ctx, config().tls_min_version == "TLSv1.3" ? TLS1_3_VERSION : TLS1_2_VERSION);
+    if ((!config().tls_cipher_list.empty() && !SSL_CTX_set_cipher_list(ctx, config().tls_cipher_list.c_str())) ||
+        (!config().tls_ciphersuites.empty() && !SSL_CTX_set_ciphersuites(ctx, config().tls_ciphersuites.c_str()))) {
+        ERR_print_errors_fp(stderr);
+        exit(EXIT_FAILURE);
+    }
+    if (config().tls_early_data) {
+        // 0-RTT needs resumption tickets, the ticket keys are created here and shared by all forked workers.
+        // OpenSSL's own anti-replay forces stateful tickets kept in a per-process cache, which would not
+        // resume on another worker, so tickets stay stateless and allow_early_data() guards against replay
+        SSL_CTX_set_options(ctx, SSL_OP_NO_ANTI_REPLAY);
+        SSL_CTX_set_timeout(ctx, config().tls_ticket_lifetime);
+        SSL_CTX_set_max_early_data(ctx, TLS_MAX_EARLY_DATA);
+        SSL_CTX_set_recv_max_early_data(ctx, TLS_MAX_EARLY_DATA);
+        SSL_CTX_set_allow_early_data_cb(ctx, allow_early_data, nullptr);
+    } else {
+        SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+    }
+    load_certificates(ctx, config().tls_certificate, config().tls_private_key);
+
+    // Shared counters and the early data anti-replay table, inherited by every forked process
+    server_metrics = create_shared<ServerMetrics>();
+    replay_cache = create_shared<EarlyDataReplayCache>();
+    rate_buckets = create_shared<RateBucket>(config().rate_limit_buckets);
+    worker_slots = create_shared<WorkerSlot>(config().workers);
+    setup_proxy_upstreams();
 
     // Create message queue for logging
-    const int msg_queue_id = msgget(LOG_MSG_QUEUE_KEY, IPC_CREAT | 0666);
+    const int msg_queue_id = msgget(config().log_msg_queue_key, IPC_CREAT | 0666);
     if (msg_queue_id == -1) {
         perror("msgget");
         exit(EXIT_FAILURE);
     }
 
     // Create upload directory if it doesn't exist
-    if (!std::filesystem::exists(UPLOAD_DIR)) {
-        std::filesystem::create_directory(UPLOAD_DIR);
+    if (!std::filesystem::exists(config().upload_dir)) {
+        std::filesystem::create_directory(config().upload_dir);
+    }
+
+    // Keep the master and the logger forked below on the housekeeping core. Without a readable CPU set
+    // there is nothing to place processes on, the server runs unpinned.
+    if (config().cpu_affinity) {
+        server_cpus = allowed_cpus();
+        if (server_cpus.empty()) {
+            log_event("CPU affinity disabled: allowed CPUs unavailable", msg_queue_id);
+            auto unpinned = std::make_unique<ServerConfig>(config());
+            unpinned->cpu_affinity = false;
+            current_config.store(unpinned.release(), std::memory_order_release);
+        } else {
+            pin_to_cpus({server_cpus.front()});
+        }
     }
 
     // Start logger process
-    const pid_t logger_pid = fork();
+    pid_t logger_pid = fork();
     if (logger_pid == 0) {
         logger_process();
         exit(0);
     }
 
+    // Reap exited children from the main loop instead of polling every worker with waitpid
+    struct sigaction child_action{};
+    child_action.sa_handler = handle_sigchld;
+    child_action.sa_flags = SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &child_action, nullptr);
+
+    // SIGUSR1 makes every worker dump its trace ring, the master forwards it from the main loop.
+    // Workers inherit the handler: SA_RESTART keeps it from failing the SSL_read, SSL_write or php-cgi
+    // read of a request in flight, an idle worker still wakes up through SO_RCVTIMEO.
+    struct sigaction trace_action{};
+    trace_action.sa_handler = request_trace_dump;
+    trace_action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &trace_action, nullptr);
+
+    // SIGUSR2 toggles the workers' sampling profiler, forwarded the same way and restarting calls alike
+    struct sigaction profiler_action{};
+    profiler_action.sa_handler = request_profiler_toggle;
+    profiler_action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR2, &profiler_action, nullptr);
+
+    // SIGHUP reloads the configuration file and makes the logger reopen its log, for external log rotation.
+    // The master reloads first to report restart-only changes, then forwards it to the logger and workers.
+    // Workers inherit this handler with SA_RESTART, a reload must not fail their in-flight requests; only
+    // the logger installs its own without it.
+    struct sigaction reload_action{};
+    reload_action.sa_handler = request_reload;
+    reload_action.sa_flags = SA_RESTART;
+    sigaction(SIGHUP, &reload_action, nullptr);
+
     // Create worker processes
-    int worker_sockets[MAX_WORKERS][2];
-    pid_t worker_pids[MAX_WORKERS];
-    for (int i = 0; i < MAX_WORKERS; i++) {
-        if (socketpair(AF_UNIX, SOCK_STREAM, 0, worker_sockets[i]) == -1) {
-            perror("socketpair");
+    std::vector<std::array<int, 2>> worker_sockets(config().workers);
+    for (int i = 0; i < config().workers; i++) {
+        spawn_worker(i, worker_sockets, msg_queue_id, ctx);
+        if (worker_slots[i].pid.load() <= 0) {
             exit(EXIT_FAILURE);
         }
-        if ((worker_pids[i] = fork()) == 0) {
-            close(worker_sockets[i][1]); // Close the parent's end
-            worker_process(worker_sockets[i][0], msg_queue_id, ctx);
-            exit(0);
-        }
-        close(worker_sockets[i][0]); // Close the child's end
     }
 
     // Set up server socket
@@ -437,81 +2781,105 @@ int main() {
     }
     address.sin_family = AF_INET;
     address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(PORT);
+    address.sin_port = htons(config().port);
     if (bind(server_fd, (sockaddr *) &address, sizeof(address)) == -1) {
         perror("bind");
         exit(EXIT_FAILURE);
     }
-    if (listen(server_fd, 10) == -1) {
+    if (listen(server_fd, config().listen_backlog) == -1) {
         perror("listen");
         exit(EXIT_FAILURE);
     }
 
-    // Main loop to accept incoming connections
+    // Main loop to accept incoming connections, waking up at least every heartbeat interval to supervise workers
     int round_robin = 0;
+    int64_t last_health_check = monotonic_ns();
     while (true) {
+        if (children_exited) {
+            reap_children(logger_pid, worker_sockets, msg_queue_id, ctx);
+        }
+        if (trace_dump_requested) {
+            trace_dump_requested = 0;
+            signal_workers(SIGUSR1);
+        }
+        if (profiler_toggle_requested) {
+            profiler_toggle_requested = 0;
+            signal_workers(SIGUSR2);
+        }
+        if (reload_requested) {
+            reload_requested = 0;
+            reload_config(msg_queue_id, true);
+            kill(logger_pid, SIGHUP);
+            signal_workers(SIGHUP);
+        }
+        if (monotonic_ns() - last_health_check >= config().worker_heartbeat_ms * 1000000LL) {
+            check_worker_health(msg_queue_id);
+            respawn_failed_workers(worker_sockets, msg_queue_id, ctx);
+            last_health_check = monotonic_ns();
+        }
+
+        pollfd listener{.fd = server_fd, .events = POLLIN, .revents = 0};
+        if (poll(&listener, 1, config().worker_heartbeat_ms) <= 0) {
+            continue;
+        }
         int client_socket = accept(server_fd, (struct sockaddr *) &address, &addrlen);
         if (client_socket == -1) {
             perror("accept");
             continue;
         }
 
-        // Check if the worker process is still alive
-        if (waitpid(worker_pids[round_robin], nullptr, WNOHANG) == 0) {
-            // Worker is still alive, send the socket
-            struct msghdr msg = {};
-            char buf[CMSG_SPACE(sizeof(int))];
-            struct iovec io = {.iov_base = &client_socket, .iov_len = sizeof(client_socket)};
-            msg.msg_iov = &io;
-            msg.msg_iovlen = 1;
-            msg.msg_control = buf;
-            msg.msg_controllen = sizeof(buf);
-            struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
-            cmsg->cmsg_len = CMSG_LEN(sizeof(int));
-            cmsg->cmsg_level = SOL_SOCKET;
-            cmsg->cmsg_type = SCM_RIGHTS;
-            memcpy(CMSG_DATA(cmsg), &client_socket, sizeof(client_socket));
-
-            if (sendmsg(worker_sockets[round_robin][1], &msg, 0) == -1) {
-                perror("sendmsg");
-            }
-            close(client_socket); // Close the client socket in the main process
-            round_robin = (round_robin + 1) % MAX_WORKERS;
-        } else {
-            // Worker is dead, restart it
-            log_event("Worker " + std::to_string(round_robin) + " is no longer alive, restarting.", msg_queue_id);
-            close(worker_sockets[round_robin][1]);
-            if (socketpair(AF_UNIX, SOCK_STREAM, 0, worker_sockets[round_robin]) == -1) {
-                perror("socketpair");
-                close(client_socket);
-                continue;
-            }
-            if ((worker_pids[round_robin] = fork()) == 0) {
-                close(worker_sockets[round_robin][1]);
-                worker_process(worker_sockets[round_robin][0], msg_queue_id, ctx);
-                exit(0);
-            }
-            close(worker_sockets[round_robin][0]);
+        // Throttle abusive clients before their connection costs a handshake or worker time. The listener
+        // speaks TLS, so a plaintext 429 would only be a garbled record to the client: the connection is
+        // reset instead, which also leaves no TIME_WAIT socket behind.
+        if (!rate_limit_allow(address.sin_addr.s_addr)) {
+            server_metrics->rate_limited++;
+            const linger reset{.l_onoff = 1, .l_linger = 0};
+            setsockopt(client_socket, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
             close(client_socket);
+            continue;
         }
 
-        // Check if all workers are busy
-        bool all_workers_busy = true;
-        for (int i = 0; i < MAX_WORKERS; i++) {
-            if (waitpid(worker_pids[i], nullptr, WNOHANG) == 0) {
-                all_workers_busy = false;
-                break;
+        // Prefer the worker pinned to the core that processed the connection's packets, so the
+        // socket's data is still in that core's cache when the worker reads it
+        int preferred = round_robin;
+        if (config().cpu_affinity && config().dispatch_by_incoming_cpu) {
+            int incoming_cpu = -1;
+            socklen_t optlen = sizeof(incoming_cpu);
+            if (getsockopt(client_socket, SOL_SOCKET, SO_INCOMING_CPU, &incoming_cpu, &optlen) == 0) {
+                const int pinned_worker = worker_for_cpu(incoming_cpu);
+                if (pinned_worker >= 0) preferred = pinned_worker;
+            }
+        }
+
+        // Dispatch to the first running worker with spare capacity, starting at the preferred one
+        int target = -1;
+        const int capacity = worker_capacity();
+        for (int i = 0; i < config().workers && target == -1; i++) {
+            const int candidate = (preferred + i) % config().workers;
+            const WorkerSlot &slot = worker_slots[candidate];
+            if (slot.pid.load() > 0 && slot.in_flight.load() < capacity) {
+                target = candidate;
             }
         }
 
-        if (all_workers_busy) {
-            // Send 503 Service Unavailable response
-            const std::string content = read_file(ERROR_503_PATH);
+        if (target == -1) {
+            // All workers are busy, send 503 Service Unavailable response
+            const std::string content = read_file(config().error_503_path.c_str());
             const std::string response =
                     "HTTP/1.1 503 Service Unavailable\r\nContent-Type: text/html\r\nConnection: close\r\n\r\n" +
                     content;
-            send(client_socket, response.c_str(), response.length(), 0);
+            send(client_socket, response.c_str(), response.length(), MSG_DONTWAIT);
             close(client_socket);
+            continue;
+        }
+
+        worker_slots[target].in_flight++;
+        if (!send_client_fd(worker_sockets[target][1], client_socket)) {
+            worker_slots[target].in_flight--;
+        }
+        close(client_socket); // Close the client socket in the main process
+        if (target == round_robin) {
+            round_robin = (round_robin + 1) % config().workers;
         }
     }
 
@@ -520,9 +2888,9 @@ int main() {
     SSL_CTX_free(ctx);
 
     // Terminate worker processes
-    for (int i = 0; i < MAX_WORKERS; i++) {
+    for (int i = 0; i < config().workers; i++) {
         close(worker_sockets[i][1]);
-        waitpid(worker_pids[i], nullptr, 0);
+        waitpid(worker_slots[i].pid.load(), nullptr, 0);
     }
 
     // Terminate logger process